@@ -4,9 +4,102 @@
 #include <algorithm>
 #include <iomanip>
 #include <limits>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <array>
+#include <iterator>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <type_traits>
+#include <map>
+#include <unordered_map>
+#include <cctype>
+#include <memory_resource>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <optional>
+#include <sstream>
+#include <csignal>
+#include <cerrno>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SMS_HAVE_MMAP 1
+#define SMS_HAVE_FSYNC 1
+#define SMS_HAVE_ISATTY 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#define SMS_HAVE_EPOLL 1
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#endif
 
 using namespace std;
 
+#ifdef SMS_COUNT_ALLOCATIONS
+// Test build only (-DSMS_COUNT_ALLOCATIONS): count every heap allocation so
+// batch mode can show which commands allocate
+#include <cstdlib>
+#include <new>
+std::atomic<size_t> allocationCount{0};
+
+// Every form of new and delete is replaced, so each block goes back to the
+// allocator it came from. The two helpers stay out of line: inlined, GCC
+// pairs free() with the caller's new expression and warns about a mismatch.
+__attribute__((noinline)) void* countedAllocate(size_t size, size_t alignment) {
+    allocationCount++;
+    if (alignment <= alignof(max_align_t)) return malloc(size ? size : 1);
+    void* p = nullptr;
+    return posix_memalign(&p, alignment, size ? size : 1) == 0 ? p : nullptr;
+}
+__attribute__((noinline)) void countedRelease(void* p) noexcept { free(p); }
+
+void* countedAllocateOrThrow(size_t size, size_t alignment) {
+    if (void* p = countedAllocate(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size) { return countedAllocateOrThrow(size, 0); }
+void* operator new[](size_t size) { return countedAllocateOrThrow(size, 0); }
+void* operator new(size_t size, std::align_val_t a) { return countedAllocateOrThrow(size, size_t(a)); }
+void* operator new[](size_t size, std::align_val_t a) { return countedAllocateOrThrow(size, size_t(a)); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return countedAllocate(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return countedAllocate(size, 0); }
+void* operator new(size_t size, std::align_val_t a, const std::nothrow_t&) noexcept { return countedAllocate(size, size_t(a)); }
+void* operator new[](size_t size, std::align_val_t a, const std::nothrow_t&) noexcept { return countedAllocate(size, size_t(a)); }
+
+void operator delete(void* p) noexcept { countedRelease(p); }
+void operator delete[](void* p) noexcept { countedRelease(p); }
+void operator delete(void* p, size_t) noexcept { countedRelease(p); }
+void operator delete[](void* p, size_t) noexcept { countedRelease(p); }
+void operator delete(void* p, std::align_val_t) noexcept { countedRelease(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { countedRelease(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { countedRelease(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { countedRelease(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { countedRelease(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { countedRelease(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { countedRelease(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { countedRelease(p); }
+#endif
+
 // Custom exception class for student-related errors
 class StudentException : public exception {
 private:
@@ -18,6 +111,187 @@ public:
     }
 };
 
+// Print one table row; shared by Student and the memory-mapped view
+void displayRow(string_view name, int rollNo, float marks, ostream& out = cout) {
+    out << left << setw(20) << name << setw(10) << rollNo << setw(10) << marks << endl;
+}
+
+// ========== Parallel Helpers ==========
+// Number of worker threads for bulk operations
+unsigned workerCount() {
+    unsigned n = thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+// Run task(0) .. task(tasks - 1), one thread per task beyond the first,
+// which runs on the calling thread. The first exception is rethrown.
+template <typename F>
+void parallelFor(size_t tasks, F&& task) {
+    if (tasks == 0) return;
+    vector<thread> threads;
+    vector<exception_ptr> errors(tasks);
+    for (size_t t = 1; t < tasks; t++) {
+        threads.emplace_back([&, t] {
+            try { task(t); } catch (...) { errors[t] = current_exception(); }
+        });
+    }
+    try { task(0); } catch (...) { errors[0] = current_exception(); }
+    for (thread& th : threads) th.join();
+    for (exception_ptr& e : errors) {
+        if (e) rethrow_exception(e);
+    }
+}
+
+// Merge sort on up to workerCount() threads: each thread sorts one run,
+// then neighbouring runs are merged pairwise, each round's merges running
+// in parallel too. Small inputs are sorted on the calling thread.
+template <typename T, typename Less>
+void parallelSort(vector<T>& items, Less less) {
+    const size_t MIN_RUN = 1 << 15;
+    size_t runs = min<size_t>(workerCount(), items.size() / MIN_RUN);
+    if (runs <= 1) {
+        sort(items.begin(), items.end(), less);
+        return;
+    }
+    vector<size_t> bounds(runs + 1);
+    for (size_t r = 0; r <= runs; r++) bounds[r] = items.size() * r / runs;
+    parallelFor(runs, [&](size_t r) { sort(items.begin() + bounds[r], items.begin() + bounds[r + 1], less); });
+
+    vector<T> buffer(items.size());
+    vector<T>* from = &items;
+    vector<T>* to = &buffer;
+    for (size_t width = 1; width < runs; width *= 2) {
+        size_t pairs = (runs + 2 * width - 1) / (2 * width);
+        parallelFor(pairs, [&](size_t p) {
+            size_t lo = bounds[min(runs, 2 * p * width)];
+            size_t mid = bounds[min(runs, (2 * p + 1) * width)];
+            size_t hi = bounds[min(runs, (2 * p + 2) * width)];
+            merge(from->begin() + lo, from->begin() + mid, from->begin() + mid, from->begin() + hi,
+                  to->begin() + lo, less);
+        });
+        swap(from, to);
+    }
+    if (from != &items) items.swap(buffer);
+}
+
+// ========== Instrumentation ==========
+// Compile-time toggle (-DSMS_INSTRUMENT): per-operation counts, latency
+// histograms and bytes read/written, shown by the "Performance Stats" menu
+// entry and the PERF command. Without the flag SMS_TIMED and
+// SMS_COUNT_BYTES expand to nothing.
+enum class PerfOp { Load, Save, Flush, FindIndex, Add, Search, Update, Delete, Display, Statistics,
+                    NameSearch, MarksQuery, Import, BatchUpdate, Replicate, Count };
+const char* const PERF_OP_NAMES[] = {"load", "save", "background save", "find index", "add", "search",
+                                     "update", "delete", "display", "statistics", "name search", "marks query",
+                                     "csv import", "batch update", "replication"};
+
+#ifdef SMS_INSTRUMENT
+// HDR-style histogram over nanoseconds: values below 16 get exact buckets,
+// larger ones log2 ranges split into 16 linear sub-buckets (under 7%
+// relative error). Counters are relaxed atomics, so recording never locks.
+class LatencyHistogram {
+private:
+    static const int SUB_BITS = 4;
+    static const size_t SUB_BUCKETS = size_t(1) << SUB_BITS;
+    static const size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    array<atomic<uint64_t>, BUCKETS> counts{};
+    atomic<uint64_t> total{0};
+    atomic<uint64_t> sumNs{0};
+    atomic<uint64_t> maxNs{0};
+
+    static size_t bucketOf(uint64_t ns) {
+        if (ns < SUB_BUCKETS) return ns;
+        int msb = 63 - __builtin_clzll(ns);
+        int shift = msb - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + ((ns >> shift) - SUB_BUCKETS);
+    }
+
+    // Largest value that lands in bucket b
+    static uint64_t bucketTop(size_t b) {
+        size_t major = b / SUB_BUCKETS;
+        if (major == 0) return b;
+        uint64_t width = uint64_t(1) << (major - 1);
+        return (SUB_BUCKETS + b % SUB_BUCKETS) * width + width - 1;
+    }
+
+public:
+    void record(uint64_t ns) {
+        counts[bucketOf(ns)].fetch_add(1, memory_order_relaxed);
+        total.fetch_add(1, memory_order_relaxed);
+        sumNs.fetch_add(ns, memory_order_relaxed);
+        uint64_t seen = maxNs.load(memory_order_relaxed);
+        while (ns > seen && !maxNs.compare_exchange_weak(seen, ns, memory_order_relaxed)) {}
+    }
+
+    uint64_t count() const { return total.load(memory_order_relaxed); }
+    uint64_t max() const { return maxNs.load(memory_order_relaxed); }
+    double mean() const { return count() ? double(sumNs.load(memory_order_relaxed)) / count() : 0.0; }
+
+    // Upper bound of the bucket holding the p-th percentile (0 < p <= 100)
+    uint64_t percentile(double p) const {
+        uint64_t n = count();
+        if (n == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(ceil(p / 100.0 * n));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < BUCKETS; b++) {
+            seen += counts[b].load(memory_order_relaxed);
+            if (seen >= rank) return std::min(bucketTop(b), max());
+        }
+        return max();
+    }
+};
+
+struct Instrumentation {
+    array<LatencyHistogram, size_t(PerfOp::Count)> latency;
+    atomic<uint64_t> bytesRead{0};
+    atomic<uint64_t> bytesWritten{0};
+};
+
+Instrumentation perf;
+
+// Records the lifetime of the enclosing scope under one operation
+class ScopedTimer {
+private:
+    PerfOp op;
+    chrono::steady_clock::time_point start;
+
+public:
+    explicit ScopedTimer(PerfOp o) : op(o), start(chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        perf.latency[size_t(op)].record(static_cast<uint64_t>(ns));
+    }
+};
+
+#define SMS_TIMED(op) ScopedTimer smsScopedTimer(PerfOp::op)
+#define SMS_COUNT_BYTES(direction, n) (perf.direction.fetch_add((n), memory_order_relaxed))
+#else
+#define SMS_TIMED(op) ((void)0)
+#define SMS_COUNT_BYTES(direction, n) ((void)0)
+#endif
+
+void reportPerformance(ostream& out) {
+#ifdef SMS_INSTRUMENT
+    auto micros = [](double ns) { return ns / 1000.0; };
+    out << "\n--- Performance Stats ---" << endl;
+    out << left << setw(16) << "Operation" << right << setw(10) << "Count" << setw(12) << "Mean us"
+        << setw(12) << "p50 us" << setw(12) << "p99 us" << setw(12) << "p99.9 us" << setw(12) << "Max us" << endl;
+    out << fixed << setprecision(2);
+    for (size_t i = 0; i < size_t(PerfOp::Count); i++) {
+        const LatencyHistogram& h = perf.latency[i];
+        if (h.count() == 0) continue;
+        out << left << setw(16) << PERF_OP_NAMES[i] << right << setw(10) << h.count()
+            << setw(12) << micros(h.mean()) << setw(12) << micros(h.percentile(50))
+            << setw(12) << micros(h.percentile(99)) << setw(12) << micros(h.percentile(99.9))
+            << setw(12) << micros(h.max()) << endl;
+    }
+    out << "Bytes read: " << perf.bytesRead.load() << "  Bytes written: " << perf.bytesWritten.load() << endl;
+#else
+    out << "Performance counters are disabled; rebuild with -DSMS_INSTRUMENT." << endl;
+#endif
+}
+
 // ========== OOP: Student Class ==========
 class Student {
 private:
@@ -27,36 +301,55 @@ private:
 
 public:
     // Constructor
-    Student(string n = "", int r = 0, float m = 0.0f) : name(n), rollNo(r), marks(m) {
+    // The name is taken by value and moved in, so callers passing a
+    // temporary pay for one allocation at most
+    explicit Student(string n = "", int r = 0, float m = 0.0f) : name(move(n)), rollNo(r), marks(m) {
         // Validate data during construction
-        if (rollNo < 0) throw StudentException("Roll number cannot be negative");
-        if (marks < 0 || marks > 100) throw StudentException("Marks must be between 0 and 100");
+        checkRollNo(rollNo);
+        checkMarks(marks);
+    }
+
+    // Validation rules, shared with stores that keep fields outside a Student
+    static const size_t MAX_NAME_LENGTH = 65535;   // the stores keep a 16-bit length
+
+    static bool validRollNo(int r) { return r >= 0; }
+    static bool validMarks(float m) { return m >= 0 && m <= 100; }
+
+    static void checkName(string_view n) {
+        if (n.empty()) throw StudentException("Name cannot be empty");
+        if (n.size() > MAX_NAME_LENGTH) throw StudentException("Name is too long");
+    }
+    static void checkRollNo(int r) {
+        if (!validRollNo(r)) throw StudentException("Roll number cannot be negative");
+    }
+    static void checkMarks(float m) {
+        if (!validMarks(m)) throw StudentException("Marks must be between 0 and 100");
     }
 
-    // Getter functions
-    string getName() const { return name; }
+    // Getter functions (no copies)
+    const string& getName() const { return name; }
     int getRollNo() const { return rollNo; }
     float getMarks() const { return marks; }
 
     // Setter functions with validation
     void setName(string n) { 
-        if (n.empty()) throw StudentException("Name cannot be empty");
-        name = n; 
+        checkName(n);
+        name = move(n); 
     }
     
     void setRollNo(int r) { 
-        if (r < 0) throw StudentException("Roll number cannot be negative");
+        checkRollNo(r);
         rollNo = r; 
     }
     
     void setMarks(float m) { 
-        if (m < 0 || m > 100) throw StudentException("Marks must be between 0 and 100");
+        checkMarks(m);
         marks = m; 
     }
 
     // Display student details
     void display() const {
-        cout << left << setw(20) << name << setw(10) << rollNo << setw(10) << marks << endl;
+        displayRow(name, rollNo, marks);
     }
 
     // For file writing
@@ -94,266 +387,6696 @@ ifstream& operator>>(ifstream& ifs, Student& s) {
     return ifs;
 }
 
-// ========== OOP: Management System Class ==========
-class StudentManagementSystem {
-private:
-    vector<Student> students;
+// ========== Record Schema and Codecs ==========
+// Student's fields described once, at compile time. Each field names its
+// type, how to read it from a Student and its validation rule; RecordSchema
+// folds over the list to generate a row-wise text codec, a row-wise binary
+// codec and the validator, each field handled by code specialized for its
+// type (no iostreams, no virtual calls). Adding a field means one more
+// descriptor in StudentSchema (in Student's constructor order), and these
+// extend with it. They back the legacy text loader, CSV import validation
+// and the replication snapshot; the columnar formats (binary students.dat,
+// the mapped view, the compressed blocks, the journal) and CSV rows keep
+// their own per-column layouts and would each need the new column added.
+string_view trimSpaces(string_view s) {
+    size_t b = s.find_first_not_of(" \t\r");
+    if (b == string_view::npos) return string_view();
+    size_t e = s.find_last_not_of(" \t\r");
+    return s.substr(b, e - b + 1);
+}
 
-    // File Handling: Load data from file with exception handling
-    void loadFromFile() {
-        ifstream file("students.dat");
-        if (!file) {
-            cout << "No existing data file found. Starting fresh." << endl;
-            return;
-        }
+// Encoding of one field value. Numbers: to_chars/from_chars text (shortest
+// round-trip for floats), native-order bytes in binary.
+template <typename T>
+struct FieldCodec {
+    static_assert(is_arithmetic<T>::value, "add a FieldCodec specialization for this field type");
+    static constexpr size_t MIN_BINARY_BYTES = sizeof(T);
 
-        try {
-            Student s;
-            while (file >> s) {
-                students.push_back(s);
-            }
-            if (file.bad()) {
-                throw StudentException("Error reading from file");
-            }
-            cout << "Data loaded successfully. " << students.size() << " records found." << endl;
-        }
-        catch (const StudentException& e) {
-            cout << "Warning: " << e.what() << ". Starting with empty database." << endl;
-            students.clear();
-        }
-        file.close();
+    static void writeText(string& out, T v) {
+        char buf[32];
+        out.append(buf, to_chars(buf, buf + sizeof(buf), v).ptr);
+    }
+    static bool readText(string_view text, T& v) {
+        text = trimSpaces(text);
+        auto r = from_chars(text.data(), text.data() + text.size(), v);
+        return !text.empty() && r.ec == errc() && r.ptr == text.data() + text.size();
     }
+    static void writeBinary(string& out, T v) { out.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    static bool readBinary(const char*& p, const char* end, T& v) {
+        if (size_t(end - p) < sizeof(v)) return false;
+        memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        return true;
+    }
+};
 
-    // File Handling: Save data to file with exception handling
-    void saveToFile() {
-        ofstream file("students.dat");
-        if (!file) {
-            throw StudentException("Cannot create data file");
-        }
+// Strings: the raw line in text, uint16 length + bytes in binary. Decoded
+// values point into the input.
+template <>
+struct FieldCodec<string_view> {
+    static constexpr size_t MIN_BINARY_BYTES = sizeof(uint16_t);
+    static void writeText(string& out, string_view v) {
+        if (v.find('\n') != string_view::npos) throw StudentException("Line breaks cannot be stored in text format");
+        out.append(v.data(), v.size());
+    }
+    static bool readText(string_view text, string_view& v) {
+        v = text;
+        return true;
+    }
+    static void writeBinary(string& out, string_view v) {
+        if (v.size() > Student::MAX_NAME_LENGTH) throw StudentException("Name is too long");
+        uint16_t length = static_cast<uint16_t>(v.size());
+        out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.append(v.data(), v.size());
+    }
+    static bool readBinary(const char*& p, const char* end, string_view& v) {
+        uint16_t length;
+        if (!FieldCodec<uint16_t>::readBinary(p, end, length) || size_t(end - p) < length) return false;
+        v = string_view(p, length);
+        p += length;
+        return true;
+    }
+};
 
-        try {
-            for (const Student& s : students) {
-                file << s;
-                if (file.fail()) {
-                    throw StudentException("Failed to write student data to file");
-                }
-            }
-            cout << "Data saved successfully. " << students.size() << " records stored." << endl;
-        }
-        catch (const StudentException& e) {
-            file.close();
-            throw StudentException(string("Save failed: ") + e.what());
-        }
-        file.close();
+struct NameField {
+    using Type = string_view;
+    static constexpr const char* label = "name";
+    static Type get(const Student& s) { return s.getName(); }
+    static void check(Type n) { Student::checkName(n); }
+};
+
+struct RollNoField {
+    using Type = int;
+    static constexpr const char* label = "roll number";
+    static Type get(const Student& s) { return s.getRollNo(); }
+    static void check(Type r) { Student::checkRollNo(r); }
+};
+
+struct MarksField {
+    using Type = float;
+    static constexpr const char* label = "marks";
+    static Type get(const Student& s) { return s.getMarks(); }
+    static void check(Type m) { Student::checkMarks(m); }
+};
+
+template <typename... Fields>
+struct RecordSchema {
+    using Values = tuple<typename Fields::Type...>;
+    static constexpr size_t FIELD_COUNT = sizeof...(Fields);
+    static constexpr size_t MIN_BINARY_BYTES = (FieldCodec<typename Fields::Type>::MIN_BINARY_BYTES + ...);
+
+    // A Student's field values (strings as views into it)
+    static Values values(const Student& s) { return Values(Fields::get(s)...); }
+
+    static Student toStudent(const Values& v) { return toStudent(v, index_sequence_for<Fields...>()); }
+
+    // Every field's rule; throws the first failure
+    static void check(const Values& v) { checkEach(v, index_sequence_for<Fields...>()); }
+
+    // Text: each field on its own line (the legacy students.dat layout)
+    static void writeText(string& out, const Values& v) { writeTextEach(out, v, index_sequence_for<Fields...>()); }
+
+    // Parse the record at p; returns the position after it
+    static const char* readText(const char* p, const char* end, Values& v) {
+        readTextEach(p, end, v, index_sequence_for<Fields...>());
+        return p;
     }
 
-    // Find student by roll number
-    int findStudentIndex(int rollNo) {
-        for (int i = 0; i < students.size(); i++) {
-            if (students[i].getRollNo() == rollNo) {
-                return i;
-            }
-        }
-        return -1;
+    // Binary: the fields back to back, no padding
+    static void writeBinary(string& out, const Values& v) { writeBinaryEach(out, v, index_sequence_for<Fields...>()); }
+
+    // Decode the record at p and advance past it; false if it is cut short
+    static bool readBinary(const char*& p, const char* end, Values& v) {
+        return readBinaryEach(p, end, v, index_sequence_for<Fields...>());
     }
 
-    // Utility function to clear invalid input
-    void clearCin() {
-        cin.clear();
-        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+private:
+    template <typename T> static T owned(T v) { return v; }
+    static string owned(string_view v) { return string(v); }
+
+    template <size_t... I>
+    static Student toStudent(const Values& v, index_sequence<I...>) { return Student(owned(get<I>(v))...); }
+
+    template <size_t... I>
+    static void checkEach(const Values& v, index_sequence<I...>) { (Fields::check(get<I>(v)), ...); }
+
+    template <size_t... I>
+    static void writeTextEach(string& out, const Values& v, index_sequence<I...>) {
+        ((FieldCodec<typename Fields::Type>::writeText(out, get<I>(v)), out += '\n'), ...);
     }
 
-public:
-    // Constructor
-    StudentManagementSystem() {
-        try {
-            loadFromFile();
-        }
-        catch (const exception& e) {
-            cout << "Initialization error: " << e.what() << endl;
+    template <typename Field>
+    static const char* readLine(const char* p, const char* end, typename Field::Type& v) {
+        if (p >= end) throw StudentException("Corrupted data in file");
+        const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+        const char* lineEnd = nl ? nl : end;
+        if (!FieldCodec<typename Field::Type>::readText(string_view(p, lineEnd - p), v)) {
+            throw StudentException(string("Failed to read ") + Field::label + " from file");
         }
+        return nl ? nl + 1 : end;
     }
 
-    // Destructor
-    ~StudentManagementSystem() {
-        try {
-            saveToFile();
-        }
-        catch (const exception& e) {
-            cout << "Shutdown error: " << e.what() << endl;
-        }
+    template <size_t... I>
+    static void readTextEach(const char*& p, const char* end, Values& v, index_sequence<I...>) {
+        ((p = readLine<Fields>(p, end, get<I>(v))), ...);
     }
 
-    // Add new student with comprehensive input validation
-    void addStudent() {
-        try {
-            string name;
-            int rollNo;
-            float marks;
+    template <size_t... I>
+    static void writeBinaryEach(string& out, const Values& v, index_sequence<I...>) {
+        (FieldCodec<typename Fields::Type>::writeBinary(out, get<I>(v)), ...);
+    }
 
-            cout << "\nEnter Student Details:\n";
-            cout << "Name: ";
-            cin.ignore();
-            getline(cin, name);
-            if (name.empty()) throw StudentException("Name cannot be empty");
+    template <size_t... I>
+    static bool readBinaryEach(const char*& p, const char* end, Values& v, index_sequence<I...>) {
+        return (FieldCodec<typename Fields::Type>::readBinary(p, end, get<I>(v)) && ...);
+    }
+};
 
-            cout << "Roll No: ";
-            if (!(cin >> rollNo)) {
-                clearCin();
-                throw StudentException("Invalid input for roll number");
-            }
-            if (rollNo < 0) throw StudentException("Roll number cannot be negative");
+using StudentSchema = RecordSchema<NameField, RollNoField, MarksField>;
 
-            cout << "Marks: ";
-            if (!(cin >> marks)) {
-                clearCin();
-                throw StudentException("Invalid input for marks");
-            }
-            if (marks < 0 || marks > 100) throw StudentException("Marks must be between 0-100");
+// ========== Name Arena ==========
+// Monotonic, chunked storage for name bytes on a std::pmr memory resource.
+// Chunks never move once allocated, so growing the arena copies nothing,
+// and a bulk load costs one allocation per 1 MiB chunk instead of one per
+// name. Names are addressed by a 32-bit handle (chunk index, offset).
+class NameArena {
+public:
+    static const uint32_t CHUNK_BITS = 20;
+    static const uint32_t CHUNK_BYTES = 1u << CHUNK_BITS;
+    static const size_t MAX_CHUNKS = size_t(1) << (32 - CHUNK_BITS);
 
-            if (findStudentIndex(rollNo) != -1) {
-                throw StudentException("Student with this Roll No already exists");
-            }
+private:
+    pmr::memory_resource* resource;
+    vector<char*> chunks;
+    size_t used = CHUNK_BYTES;   // bytes used in the last chunk (full = none yet)
+    size_t appended = 0;         // total name bytes ever appended
 
-            Student newStudent(name, rollNo, marks);
-            students.push_back(newStudent);
-            cout << "Student added successfully!" << endl;
-        }
-        catch (const StudentException& e) {
-            cout << "Error: " << e.what() << endl;
-        }
-        catch (...) {
-            cout << "Unexpected error occurred while adding student" << endl;
-        }
+    void release() {
+        for (char* chunk : chunks) resource->deallocate(chunk, CHUNK_BYTES);
+        chunks.clear();
+        used = CHUNK_BYTES;
+        appended = 0;
     }
 
-    // Display all students
-    void displayAll() {
-        if (students.empty()) {
-            cout << "No students found!" << endl;
-            return;
+    void copyFrom(const NameArena& other) {
+        for (size_t c = 0; c < other.chunks.size(); c++) {
+            chunks.push_back(static_cast<char*>(resource->allocate(CHUNK_BYTES)));
+            size_t bytes = c + 1 == other.chunks.size() ? other.used : CHUNK_BYTES;
+            memcpy(chunks.back(), other.chunks[c], bytes);
         }
+        used = other.used;
+        appended = other.appended;
+    }
 
-        cout << "\n" << left << setw(20) << "Name" << setw(10) << "Roll No" << setw(10) << "Marks" << endl;
-        cout << "----------------------------------------" << endl;
-        for (const Student& s : students) {
-            s.display();
+public:
+    explicit NameArena(pmr::memory_resource* r = pmr::get_default_resource()) : resource(r) {}
+    NameArena(const NameArena& other) : resource(pmr::get_default_resource()) { copyFrom(other); }
+    NameArena(NameArena&& other) noexcept
+        : resource(other.resource), chunks(move(other.chunks)), used(other.used), appended(other.appended) {
+        other.chunks.clear();
+        other.used = CHUNK_BYTES;
+        other.appended = 0;
+    }
+    NameArena& operator=(const NameArena& other) {
+        if (this != &other) {
+            release();
+            copyFrom(other);
         }
+        return *this;
     }
+    NameArena& operator=(NameArena&& other) noexcept {
+        if (this != &other) {
+            release();
+            resource = other.resource;
+            chunks = move(other.chunks);
+            used = other.used;
+            appended = other.appended;
+            other.chunks.clear();
+            other.used = CHUNK_BYTES;
+            other.appended = 0;
+        }
+        return *this;
+    }
+    ~NameArena() { release(); }
 
-    // Search student by roll number with input validation
-    void searchStudent() {
-        try {
-            int rollNo;
-            cout << "Enter Roll No to search: ";
-            if (!(cin >> rollNo)) {
-                clearCin();
-                throw StudentException("Invalid input for roll number");
-            }
-
-            int index = findStudentIndex(rollNo);
-            if (index == -1) {
-                throw StudentException("Student not found");
-            }
+    pmr::memory_resource* memoryResource() const { return resource; }
 
-            cout << "\nStudent Found:" << endl;
-            cout << left << setw(20) << "Name" << setw(10) << "Roll No" << setw(10) << "Marks" << endl;
-            cout << "----------------------------------------" << endl;
-            students[index].display();
-        }
-        catch (const StudentException& e) {
-            cout << "Error: " << e.what() << endl;
+    // Copy `name` (at most CHUNK_BYTES long) into the arena
+    uint32_t append(string_view name) {
+        if (CHUNK_BYTES - used < name.size()) {
+            if (chunks.size() == MAX_CHUNKS) throw StudentException("Name data too large");
+            chunks.push_back(static_cast<char*>(resource->allocate(CHUNK_BYTES)));
+            used = 0;
         }
+        uint32_t handle = static_cast<uint32_t>(((chunks.size() - 1) << CHUNK_BITS) | used);
+        memcpy(chunks.back() + used, name.data(), name.size());
+        used += name.size();
+        appended += name.size();
+        return handle;
     }
 
-    // Update student details with validation
-    void updateStudent() {
-        try {
-            int rollNo;
-            cout << "Enter Roll No to update: ";
-            if (!(cin >> rollNo)) {
-                clearCin();
-                throw StudentException("Invalid input for roll number");
-            }
+    const char* at(uint32_t handle) const {
+        return chunks[handle >> CHUNK_BITS] + (handle & (CHUNK_BYTES - 1));
+    }
 
-            int index = findStudentIndex(rollNo);
-            if (index == -1) {
-                throw StudentException("Student not found");
-            }
+    void clear() { release(); }
+    size_t bytesAppended() const { return appended; }
+    size_t bytesReserved() const { return chunks.size() * size_t(CHUNK_BYTES); }
+};
 
-            string name;
-            float marks;
+// ========== Struct-of-Arrays Record Store ==========
+// Keeps each Student field in its own column so a scan over one field (e.g.
+// marks in showStatistics) reads contiguous memory only. Each name slot is
+// 8 bytes: names of up to 6 bytes are stored inline in the slot, longer ones
+// in the NameArena. Replaced or erased names leave dead arena bytes that are
+// reclaimed once they outweigh the live ones.
+// Erasing a record only tombstones its slot (rollNo = TOMBSTONE) so it is
+// O(1) and keeps the order of the others; compact() squeezes the holes out.
+class StudentStore {
+public:
+    static const size_t MAX_NAME_LENGTH = Student::MAX_NAME_LENGTH;
+    static const size_t INLINE_NAME_BYTES = 6;
 
-            cout << "Enter new Name: ";
-            cin.ignore();
-            getline(cin, name);
-            if (name.empty()) throw StudentException("Name cannot be empty");
+private:
+    struct NameRef {
+        uint16_t length;
+        char bytes[INLINE_NAME_BYTES];   // the name itself, or a 4-byte arena handle
 
-            cout << "Enter new Marks: ";
-            if (!(cin >> marks)) {
-                clearCin();
-                throw StudentException("Invalid input for marks");
-            }
-            if (marks < 0 || marks > 100) throw StudentException("Marks must be between 0-100");
+        bool isInline() const { return length <= INLINE_NAME_BYTES; }
+        uint32_t handle() const {
+            uint32_t h;
+            memcpy(&h, bytes, sizeof(h));
+            return h;
+        }
+    };
+    static_assert(sizeof(NameRef) == 8, "name slots should stay 8 bytes");
 
-            students[index].setName(name);
-            students[index].setMarks(marks);
-            cout << "Student details updated successfully!" << endl;
+    pmr::vector<int32_t> rollNos;
+    pmr::vector<float> marks;
+    pmr::vector<NameRef> names;
+    NameArena nameArena;
+    size_t deadNameBytes = 0;
+    size_t deadSlots = 0;
+
+    NameRef makeName(string_view name) {
+        if (name.size() > MAX_NAME_LENGTH) throw StudentException("Name is too long");
+        NameRef ref = {};
+        ref.length = static_cast<uint16_t>(name.size());
+        if (ref.isInline()) {
+            copy(name.begin(), name.end(), ref.bytes);   // name may be an empty view with no data
         }
-        catch (const StudentException& e) {
-            cout << "Error: " << e.what() << endl;
+        else {
+            uint32_t handle = nameArena.append(name);
+            memcpy(ref.bytes, &handle, sizeof(handle));
         }
+        return ref;
     }
 
-    // Delete student with validation
-    void deleteStudent() {
-        try {
-            int rollNo;
-            cout << "Enter Roll No to delete: ";
-            if (!(cin >> rollNo)) {
-                clearCin();
-                throw StudentException("Invalid input for roll number");
-            }
+    void releaseName(size_t i) {
+        if (!names[i].isInline()) deadNameBytes += names[i].length;
+        names[i].length = 0;
+    }
 
-            int index = findStudentIndex(rollNo);
-            if (index == -1) {
-                throw StudentException("Student not found");
-            }
+    void maybeCompactNames() {
+        size_t arenaBytes = nameArena.bytesAppended();
+        if (deadNameBytes > arenaBytes / 2 && deadNameBytes > 4096) compactNames();
+    }
 
-            students.erase(students.begin() + index);
-            cout << "Student deleted successfully!" << endl;
-        }
-        catch (const StudentException& e) {
-            cout << "Error: " << e.what() << endl;
+    // Rewrite the arena with only live names, in record order
+    void compactNames() {
+        NameArena packed(nameArena.memoryResource());
+        for (NameRef& ref : names) {
+            if (ref.isInline()) continue;
+            uint32_t handle = packed.append(string_view(nameArena.at(ref.handle()), ref.length));
+            memcpy(ref.bytes, &handle, sizeof(handle));
         }
+        nameArena = move(packed);
+        deadNameBytes = 0;
     }
 
-    // Show statistics
-    void showStatistics() {
-        if (students.empty()) {
-            cout << "No students found!" << endl;
-            return;
-        }
+public:
+    static const int32_t TOMBSTONE = -1;   // roll numbers are never negative
 
-        float total = 0, maxMarks = students[0].getMarks(), minMarks = students[0].getMarks();
-        for (const Student& s : students) {
-            total += s.getMarks();
-            if (s.getMarks() > maxMarks) maxMarks = s.getMarks();
-            if (s.getMarks() < minMarks) minMarks = s.getMarks();
-        }
+    // All columns and the arena allocate from `resource` (e.g. a
+    // pmr::monotonic_buffer_resource for a one-shot bulk load)
+    explicit StudentStore(pmr::memory_resource* resource = pmr::get_default_resource())
+        : rollNos(resource), marks(resource), names(resource), nameArena(resource) {}
+
+    // size() counts slots, tombstones included; liveCount() only records
+    size_t size() const { return rollNos.size(); }
+    size_t liveCount() const { return rollNos.size() - deadSlots; }
+    size_t deadCount() const { return deadSlots; }
+    bool empty() const { return liveCount() == 0; }
+    bool isLive(size_t i) const { return rollNos[i] != TOMBSTONE; }
 
-        cout << "\n--- Statistics ---" << endl;
-        cout << "Total Students: " << students.size() << endl;
-        cout << "Average Marks: " << fixed << setprecision(2) << (total / students.size()) << endl;
-        cout << "Highest Marks: " << maxMarks << endl;
-        cout << "Lowest Marks: " << minMarks << endl;
+    void reserve(size_t n) {
+        rollNos.reserve(n);
+        marks.reserve(n);
+        names.reserve(n);
     }
-};
 
-// ========== Main Function ==========
-int main() {
+    void clear() {
+        rollNos.clear();
+        marks.clear();
+        names.clear();
+        nameArena.clear();
+        deadNameBytes = 0;
+        deadSlots = 0;
+    }
+
+    // Heap bytes held by the columns and the name arena
+    size_t memoryUsage() const {
+        return rollNos.capacity() * sizeof(int32_t) + marks.capacity() * sizeof(float)
+             + names.capacity() * sizeof(NameRef) + nameArena.bytesReserved();
+    }
+
+    int rollNoAt(size_t i) const { return rollNos[i]; }
+    float marksAt(size_t i) const { return marks[i]; }
+    string_view nameAt(size_t i) const {
+        const NameRef& ref = names[i];
+        return string_view(ref.isInline() ? ref.bytes : nameArena.at(ref.handle()), ref.length);
+    }
+
+    const int32_t* rollNoColumn() const { return rollNos.data(); }
+    const float* marksColumn() const { return marks.data(); }
+
+    // Student view of one record, so code written against Student keeps working
+    Student operator[](size_t i) const { return Student(string(nameAt(i)), rollNos[i], marks[i]); }
+
+    void push_back(const Student& s) { append(s.getName(), s.getRollNo(), s.getMarks()); }
+
+    // Build a record in place from its fields; the name is copied straight
+    // into its slot or the arena without a temporary Student or string
+    void emplace_back(string_view name, int rollNo, float m) { append(name, rollNo, m); }
+
+    // Append fields that have already been validated
+    void append(string_view name, int rollNo, float m) {
+        names.push_back(makeName(name));
+        rollNos.push_back(rollNo);
+        marks.push_back(m);
+    }
+
+    void update(size_t i, string_view name, float m) {
+        marks[i] = m;
+        if (name == nameAt(i)) return;
+        NameRef ref = makeName(name);
+        releaseName(i);
+        names[i] = ref;
+        maybeCompactNames();
+    }
+
+    // O(1): tombstone the slot; later slots keep their positions
+    void erase(size_t i) {
+        if (!isLive(i)) return;
+        releaseName(i);
+        rollNos[i] = TOMBSTONE;
+        deadSlots++;
+        maybeCompactNames();
+    }
+
+    // Drop tombstoned slots, keeping the live records in their order
+    void compact() {
+        if (deadSlots == 0) return;
+        size_t out = 0;
+        for (size_t i = 0; i < size(); i++) {
+            if (!isLive(i)) continue;
+            rollNos[out] = rollNos[i];
+            marks[out] = marks[i];
+            names[out] = names[i];
+            out++;
+        }
+        rollNos.resize(out);
+        marks.resize(out);
+        names.resize(out);
+        deadSlots = 0;
+        compactNames();
+    }
+
+    void display(size_t i, ostream& out = cout) const { displayRow(nameAt(i), rollNos[i], marks[i], out); }
+};
+
+// ========== Double-Buffered File Writer ==========
+// Output buffered in two 1 MiB halves: the caller fills one while a helper
+// thread writes the other, so encoding a snapshot overlaps with disk I/O.
+// write() blocks only when both halves are full.
+class DoubleBufferedWriter {
+private:
+    static const size_t BUFFER_BYTES = 1 << 20;
+
+    ofstream file;
+    string front;          // being filled by the caller
+    string back;           // being written by the I/O thread
+    bool backFull = false;
+    bool finished = false;
+    bool failed = false;
+    mutex lock;
+    condition_variable changed;
+    thread io;
+
+    void ioLoop() {
+        unique_lock<mutex> guard(lock);
+        for (;;) {
+            changed.wait(guard, [this] { return backFull || finished; });
+            if (!backFull) return;
+            guard.unlock();
+            file.write(back.data(), back.size());
+            bool bad = file.fail();
+            guard.lock();
+            failed = failed || bad;
+            back.clear();
+            backFull = false;
+            changed.notify_all();
+        }
+    }
+
+    // Hand the filled front half to the I/O thread
+    void swapHalves() {
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [this] { return !backFull; });
+        swap(front, back);
+        backFull = true;
+        changed.notify_all();
+    }
+
+    void stop() {
+        {
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [this] { return !backFull; });
+            finished = true;
+        }
+        changed.notify_all();
+        io.join();
+    }
+
+public:
+    explicit DoubleBufferedWriter(const string& path) : file(path, ios::binary | ios::trunc) {
+        if (!file) throw StudentException("Cannot create data file");
+        front.reserve(BUFFER_BYTES);
+        back.reserve(BUFFER_BYTES);
+        io = thread(&DoubleBufferedWriter::ioLoop, this);
+    }
+
+    // Abandoned writers (an exception mid-snapshot) still stop their thread
+    ~DoubleBufferedWriter() {
+        if (io.joinable()) stop();
+    }
+
+    void write(const void* data, size_t bytes) {
+        const char* p = static_cast<const char*>(data);
+        while (bytes > 0) {
+            size_t take = min(bytes, BUFFER_BYTES - front.size());
+            front.append(p, take);
+            p += take;
+            bytes -= take;
+            if (front.size() == BUFFER_BYTES) swapHalves();
+        }
+    }
+
+    // Write out everything and close the file; throws if any write failed
+    void close() {
+        if (!front.empty()) swapHalves();
+        stop();
+        file.close();
+        if (failed || file.fail()) throw StudentException("Failed to write student data to file");
+    }
+};
+
+// ========== Binary Columnar File Format ==========
+// Layout (native byte order, every column 4-byte aligned):
+//   BinaryHeader
+//   int32   rollNo[count]
+//   float   marks[count]
+//   uint32  nameOffsets[count + 1]   (byte offsets into the name heap)
+//   char    nameHeap[nameHeapBytes]
+// Each column is written and read with a single bulk call.
+const char BINARY_MAGIC[4] = {'S', 'M', 'S', 'B'};
+const uint32_t BINARY_VERSION = 2;
+
+struct BinaryHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t count;
+    uint64_t nameHeapBytes;
+    uint64_t journalSeq;   // version 2+: last journal entry folded into this file
+};
+
+// Version 1 headers stop before journalSeq
+size_t binaryHeaderSize(uint32_t version) {
+    return version == 1 ? offsetof(BinaryHeader, journalSeq) : sizeof(BinaryHeader);
+}
+
+// Returns true if the stream starts with the given 4-byte magic.
+// The stream is rewound to the beginning either way.
+bool hasMagic(ifstream& ifs, const char (&expected)[4]) {
+    char magic[4] = {};
+    ifs.read(magic, sizeof(magic));
+    bool match = ifs.gcount() == sizeof(magic) && equal(magic, magic + 4, expected);
+    ifs.clear();
+    ifs.seekg(0);
+    return match;
+}
+
+bool isBinaryFormat(ifstream& ifs) { return hasMagic(ifs, BINARY_MAGIC); }
+
+// Write one column for every live slot, one bulk call per run of live slots
+template <typename T>
+void writeLiveColumn(DoubleBufferedWriter& out, const StudentStore& students, const T* column) {
+    size_t n = students.size();
+    for (size_t i = 0; i < n;) {
+        if (!students.isLive(i)) {
+            i++;
+            continue;
+        }
+        size_t end = i;
+        while (end < n && students.isLive(end)) end++;
+        out.write(column + i, (end - i) * sizeof(T));
+        i = end;
+    }
+}
+
+// Files never contain tombstones: dead slots are skipped while writing.
+// The store's arena may hold dead or out-of-order names, so the name heap
+// is written packed, streamed name by name into the write buffers.
+void writeBinary(DoubleBufferedWriter& out, const StudentStore& students, uint64_t journalSeq) {
+    vector<uint32_t> nameOffsets;
+    nameOffsets.reserve(students.liveCount() + 1);
+    uint64_t heapBytes = 0;
+    for (size_t i = 0; i < students.size(); i++) {
+        if (!students.isLive(i)) continue;
+        nameOffsets.push_back(static_cast<uint32_t>(heapBytes));
+        heapBytes += students.nameAt(i).size();
+        if (heapBytes > numeric_limits<uint32_t>::max()) {
+            throw StudentException("Name data too large for binary format");
+        }
+    }
+    nameOffsets.push_back(static_cast<uint32_t>(heapBytes));
+
+    BinaryHeader header;
+    copy(BINARY_MAGIC, BINARY_MAGIC + 4, header.magic);
+    header.version = BINARY_VERSION;
+    header.count = students.liveCount();
+    header.nameHeapBytes = heapBytes;
+    header.journalSeq = journalSeq;
+
+    out.write(&header, sizeof(header));
+    writeLiveColumn(out, students, students.rollNoColumn());
+    writeLiveColumn(out, students, students.marksColumn());
+    out.write(nameOffsets.data(), nameOffsets.size() * sizeof(uint32_t));
+    for (size_t i = 0; i < students.size(); i++) {
+        if (!students.isLive(i)) continue;
+        string_view name = students.nameAt(i);
+        out.write(name.data(), name.size());
+    }
+}
+
+// ========== Memory-Mapped Read-Only View ==========
+// Maps a whole file read-only. Falls back to reading it into memory on
+// platforms without mmap, so callers never need to care which one they got.
+class MappedFile {
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+#ifndef SMS_HAVE_MMAP
+    vector<char> buffer;
+#endif
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const string& path) {
+        close();
+#ifdef SMS_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);   // the mapping keeps its own reference to the file
+        if (p == MAP_FAILED) return false;
+        bytes = static_cast<const char*>(p);
+        length = static_cast<size_t>(st.st_size);
+#else
+        ifstream file(path, ios::binary | ios::ate);
+        if (!file) return false;
+        buffer.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(buffer.data(), buffer.size());
+        if (file.fail() || buffer.empty()) return false;
+        bytes = buffer.data();
+        length = buffer.size();
+#endif
+        return true;
+    }
+
+    void close() {
+#ifdef SMS_HAVE_MMAP
+        if (bytes) munmap(const_cast<char*>(bytes), length);
+#else
+        buffer.clear();
+        buffer.shrink_to_fit();
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    bool isOpen() const { return bytes != nullptr; }
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+// Column pointers into a mapped binary file. Only the header and column
+// bounds are checked up front; nothing else is touched until it is read.
+// Copies share the mapping, which lasts until the last of them lets go.
+class MappedRoster {
+private:
+    shared_ptr<MappedFile> file;
+    size_t count = 0;
+    const int32_t* rollNos = nullptr;
+    const float* marks = nullptr;
+    const uint32_t* nameOffsets = nullptr;
+    const char* nameHeap = nullptr;
+    uint64_t nameHeapBytes = 0;
+    uint64_t journalSeq = 0;
+
+public:
+    void open(const string& path) {
+        file = make_shared<MappedFile>();
+        if (!file->open(path)) throw StudentException("Cannot map data file");
+
+        BinaryHeader header = {};
+        if (file->size() < offsetof(BinaryHeader, count)) throw StudentException("Truncated file header");
+        copy(file->data(), file->data() + offsetof(BinaryHeader, count), reinterpret_cast<char*>(&header));
+        if (header.version < 1 || header.version > BINARY_VERSION) {
+            throw StudentException("Unsupported file version " + to_string(header.version));
+        }
+        size_t headerSize = binaryHeaderSize(header.version);
+        if (file->size() < headerSize) throw StudentException("Truncated file header");
+        copy(file->data(), file->data() + headerSize, reinterpret_cast<char*>(&header));
+
+        uint64_t n = header.count;
+        uint64_t expected = headerSize + n * (sizeof(int32_t) + sizeof(float))
+                          + (n + 1) * sizeof(uint32_t) + header.nameHeapBytes;
+        if (expected != file->size()) throw StudentException("Corrupted data in file");
+
+        const char* p = file->data() + headerSize;
+        count = n;
+        rollNos = reinterpret_cast<const int32_t*>(p);
+        marks = reinterpret_cast<const float*>(p + n * sizeof(int32_t));
+        nameOffsets = reinterpret_cast<const uint32_t*>(p + n * (sizeof(int32_t) + sizeof(float)));
+        nameHeap = reinterpret_cast<const char*>(nameOffsets + n + 1);
+        nameHeapBytes = header.nameHeapBytes;
+        journalSeq = header.journalSeq;
+    }
+
+    void close() {
+        file.reset();
+        count = 0;
+    }
+
+    bool isOpen() const { return file && file->isOpen(); }
+    size_t size() const { return count; }
+    uint64_t lastJournalSeq() const { return journalSeq; }
+    int rollNoAt(size_t i) const { return rollNos[i]; }
+    float marksAt(size_t i) const { return marks[i]; }
+    const float* marksColumn() const { return marks; }
+
+    string_view nameAt(size_t i) const {
+        uint32_t begin = nameOffsets[i], end = nameOffsets[i + 1];
+        if (begin > end || end > nameHeapBytes) throw StudentException("Corrupted data in file");
+        return string_view(nameHeap + begin, end - begin);
+    }
+};
+
+// ========== Parallel Text Loader ==========
+// Parses the legacy three-lines-per-record text format on all cores:
+//   1. each thread counts newlines in its byte range,
+//   2. a prefix sum gives every range its starting line number, so each
+//      thread can find the first record (line number divisible by 3) that
+//      starts inside its range,
+//   3. each thread parses the records starting in its range with from_chars.
+// Chunk results come back in file order for the caller to merge.
+
+// Parse one record at `p`; returns the position after it
+const char* parseTextRecord(const char* p, const char* end, StudentStore& out) {
+    StudentSchema::Values record;
+    p = StudentSchema::readText(p, end, record);
+    StudentSchema::check(record);
+    apply([&](auto... fields) { out.append(fields...); }, record);
+    return p;
+}
+
+vector<StudentStore> parseTextRoster(const char* data, size_t size) {
+    const size_t MIN_CHUNK = 1 << 20;   // not worth a thread below this
+    size_t chunks = max<size_t>(1, min<size_t>(workerCount(), size / MIN_CHUNK));
+    vector<size_t> begins(chunks + 1);
+    for (size_t t = 0; t <= chunks; t++) begins[t] = size * t / chunks;
+
+    vector<uint64_t> newlines(chunks);
+    parallelFor(chunks, [&](size_t t) {
+        newlines[t] = count(data + begins[t], data + begins[t + 1], '\n');
+    });
+
+    vector<StudentStore> results(chunks);
+    parallelFor(chunks, [&](size_t t) {
+        uint64_t line = 0;
+        for (size_t k = 0; k < t; k++) line += newlines[k];
+
+        // First line that starts inside this range
+        const char* p = data + begins[t];
+        const char* rangeEnd = data + begins[t + 1];
+        const char* end = data + size;
+        if (t > 0 && p[-1] != '\n') {
+            const char* nl = static_cast<const char*>(memchr(p, '\n', rangeEnd - p));
+            if (!nl) return;
+            p = nl + 1;
+            line++;
+        }
+        // Advance to the next record boundary
+        while (line % 3 != 0 && p < rangeEnd) {
+            const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+            p = nl ? nl + 1 : end;
+            line++;
+        }
+        while (p < rangeEnd) {
+            p = parseTextRecord(p, end, results[t]);
+        }
+    });
+    return results;
+}
+
+// ========== Buffered Table Output ==========
+// Formats rows into a reusable buffer by hand (no iostream manipulators,
+// no per-row flush) and hands it to the stream in large blocks. Each
+// thread keeps one buffer that its writers borrow and give back, so a
+// listing allocates nothing once the thread has listed before.
+enum class TableFormat { Table, CSV, TSV };
+
+class TableWriter {
+private:
+    ostream& out;
+    TableFormat format;
+    string buffer;
+    static const size_t FLUSH_BYTES = 64 * 1024;
+
+    // The thread's buffer while no writer has it; a nested writer finds it
+    // empty and makes its own
+    static string& spare() {
+        thread_local string buffer;
+        return buffer;
+    }
+
+    void pad(size_t written, size_t width) {
+        if (written < width) buffer.append(width - written, ' ');
+    }
+
+    template <typename T>
+    size_t appendNumber(T value) {
+        char digits[32];
+        to_chars_result r;
+        if constexpr (is_floating_point<T>::value) {
+            r = to_chars(digits, digits + sizeof(digits), value, chars_format::general, 6);
+        }
+        else {
+            r = to_chars(digits, digits + sizeof(digits), value);
+        }
+        buffer.append(digits, r.ptr - digits);
+        return r.ptr - digits;
+    }
+
+    void appendName(string_view name) {
+        if (format == TableFormat::CSV && name.find_first_of(",\"\r\n") != string_view::npos) {
+            buffer += '"';
+            for (char c : name) {
+                if (c == '"') buffer += '"';
+                buffer += c;
+            }
+            buffer += '"';
+        }
+        else if (format == TableFormat::TSV && name.find_first_of("\t\r\n") != string_view::npos) {
+            for (char c : name) buffer += (c == '\t' || c == '\r' || c == '\n') ? ' ' : c;
+        }
+        else {
+            buffer.append(name.data(), name.size());
+        }
+    }
+
+public:
+    TableWriter(ostream& os, TableFormat fmt = TableFormat::Table) : out(os), format(fmt) {
+        buffer.swap(spare());
+        buffer.reserve(FLUSH_BYTES + 256);
+    }
+    ~TableWriter() {
+        flush();
+        spare().swap(buffer);
+    }
+
+    void header() {
+        switch (format) {
+            case TableFormat::Table:
+                buffer += "\nName                Roll No   Marks     \n";
+                buffer += "----------------------------------------\n";
+                break;
+            case TableFormat::CSV: buffer += "name,rollNo,marks\n"; break;
+            case TableFormat::TSV: buffer += "name\trollNo\tmarks\n"; break;
+        }
+    }
+
+    void row(string_view name, int rollNo, float marks) {
+        if (format == TableFormat::Table) {
+            buffer.append(name.data(), name.size());
+            pad(name.size(), 20);
+            pad(appendNumber(rollNo), 10);
+            pad(appendNumber(marks), 10);
+        }
+        else {
+            char separator = format == TableFormat::CSV ? ',' : '\t';
+            appendName(name);
+            buffer += separator;
+            appendNumber(rollNo);
+            buffer += separator;
+            appendNumber(marks);
+        }
+        buffer += '\n';
+        if (buffer.size() >= FLUSH_BYTES) flush();
+    }
+
+    void flush() {
+        if (buffer.empty()) return;
+        out.write(buffer.data(), buffer.size());
+        out.flush();
+        buffer.clear();
+    }
+};
+
+// Parse "table", "csv" or "tsv"
+TableFormat parseTableFormat(string_view name) {
+    if (name.empty() || name == "table") return TableFormat::Table;
+    if (name == "csv") return TableFormat::CSV;
+    if (name == "tsv") return TableFormat::TSV;
+    throw StudentException("Unknown output format '" + string(name) + "'");
+}
+
+// Listing orders: insertion order, or a sorted view by name (ignoring
+// case), roll number, or marks (highest first). Ties go by roll number.
+enum class SortKey { Insertion, Name, RollNo, Marks };
+
+bool parseSortKey(string_view name, SortKey& key) {
+    if (name == "name") key = SortKey::Name;
+    else if (name == "roll") key = SortKey::RollNo;
+    else if (name == "marks") key = SortKey::Marks;
+    else return false;
+    return true;
+}
+
+// ========== Streaming CSV Import ==========
+// Reads the rows --export csv writes (name,rollNo,marks; a name is quoted
+// when it holds a comma, quote or newline) through one fixed 1 MiB buffer,
+// a batch at a time, so memory stays bounded whatever the file size. Rows
+// are checked against the Student rules; failures come back as rejects
+// with the reason instead of aborting the import.
+struct CsvReject {
+    uint64_t line;
+    string reason;
+    string row;
+};
+
+class CsvReader {
+private:
+    static const size_t BUFFER_BYTES = 1 << 20;   // also the longest row accepted
+
+    ifstream file;
+    vector<char> buffer;
+    size_t begin = 0, end = 0;   // unread bytes
+    bool atEof = false;
+    uint64_t line = 1;           // line the next record starts on
+
+    void refill() {
+        memmove(buffer.data(), buffer.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+        file.read(buffer.data() + end, buffer.size() - end);
+        SMS_COUNT_BYTES(bytesRead, file.gcount());
+        if (file.gcount() == 0) atEof = true;
+        end += file.gcount();
+    }
+
+    // Next record (newlines inside quotes included), without its '\n'.
+    // A record that does not fit in the buffer is skipped and reported by
+    // setting `tooLong`. Returns false at end of file.
+    bool nextRecord(string_view& record, bool& tooLong) {
+        tooLong = false;
+        bool quoted = false;
+        size_t scan = begin;
+        for (;;) {
+            for (; scan < end; scan++) {
+                char c = buffer[scan];
+                if (c == '"') {
+                    quoted = !quoted;
+                }
+                else if (c == '\n') {
+                    line++;
+                    if (quoted) continue;
+                    record = string_view(buffer.data() + begin, scan - begin);
+                    begin = scan + 1;
+                    return true;
+                }
+            }
+            if (atEof) {
+                if (begin == end && !tooLong) return false;
+                record = string_view(buffer.data() + begin, end - begin);
+                begin = end;
+                return true;
+            }
+            if (begin == 0 && end == buffer.size()) {
+                tooLong = true;   // drop what we have and keep looking for its end
+                begin = end;
+            }
+            scan -= begin;
+            refill();
+        }
+    }
+
+    // Split and check one row. Returns the reason it was rejected, or an
+    // empty string with `out` holding the parsed record.
+    static string parseRow(string_view row, StudentStore& out, string& name) {
+        size_t pos = 0;
+        name.clear();
+        if (!row.empty() && row[0] == '"') {
+            for (pos = 1;; pos++) {
+                if (pos >= row.size()) return "Unterminated quoted name";
+                if (row[pos] == '"') {
+                    if (pos + 1 < row.size() && row[pos + 1] == '"') {
+                        name += '"';
+                        pos++;
+                    }
+                    else {
+                        pos++;
+                        break;
+                    }
+                }
+                else {
+                    name += row[pos];
+                }
+            }
+            if (pos >= row.size() || row[pos] != ',') return "Expected 3 fields: name,rollNo,marks";
+        }
+        else {
+            pos = row.find(',');
+            if (pos == string_view::npos) return "Expected 3 fields: name,rollNo,marks";
+            name.assign(row.data(), pos);
+        }
+        string_view rest = row.substr(pos + 1);
+        size_t comma = rest.find(',');
+        if (comma == string_view::npos || rest.find(',', comma + 1) != string_view::npos) {
+            return "Expected 3 fields: name,rollNo,marks";
+        }
+        string_view rollText = trimSpaces(rest.substr(0, comma)), marksText = trimSpaces(rest.substr(comma + 1));
+
+        int rollNo = 0;
+        float marks = 0;
+        auto r = from_chars(rollText.data(), rollText.data() + rollText.size(), rollNo);
+        if (rollText.empty() || r.ec != errc() || r.ptr != rollText.data() + rollText.size()) {
+            return "Invalid roll number";
+        }
+        auto m = from_chars(marksText.data(), marksText.data() + marksText.size(), marks);
+        if (marksText.empty() || m.ec != errc() || m.ptr != marksText.data() + marksText.size()) {
+            return "Invalid marks";
+        }
+        StudentSchema::Values record(name, rollNo, marks);
+        try {
+            StudentSchema::check(record);
+        }
+        catch (const StudentException& e) {
+            return e.what();
+        }
+        apply([&](auto... fields) { out.append(fields...); }, record);
+        return string();
+    }
+
+public:
+    explicit CsvReader(const string& path) : file(path, ios::binary), buffer(BUFFER_BYTES) {
+        if (!file) throw StudentException("Cannot open " + path);
+    }
+
+    // Parse up to maxRows valid rows into `rows` (with the line each starts
+    // on in `lines`), collecting failures in `rejects`. A header line and
+    // blank lines are skipped. Returns false once the file is exhausted.
+    bool readBatch(StudentStore& rows, vector<uint64_t>& lines, vector<CsvReject>& rejects, size_t maxRows) {
+        string name;
+        string_view record;
+        bool tooLong;
+        while (rows.size() < maxRows) {
+            uint64_t first = line;
+            if (!nextRecord(record, tooLong)) return false;
+            if (tooLong) {
+                rejects.push_back(CsvReject{first, "Row longer than 1 MiB", string()});
+                continue;
+            }
+            if (!record.empty() && record.back() == '\r') record.remove_suffix(1);
+            if (trimSpaces(record).empty()) continue;
+            if (first == 1 && record == "name,rollNo,marks") continue;
+            string reason = parseRow(record, rows, name);
+            if (reason.empty()) lines.push_back(first);
+            else rejects.push_back(CsvReject{first, move(reason), string(record)});
+        }
+        return true;
+    }
+};
+
+// Rejected rows go to a CSV side file (line,reason,row), created on the
+// first reject, to be fixed up and imported again
+class RejectLog {
+private:
+    string path;
+    ofstream file;
+    size_t written = 0;
+
+    static void quoted(ofstream& out, string_view text) {
+        out << '"';
+        for (char c : text) {
+            if (c == '"') out << '"';
+            out << c;
+        }
+        out << '"';
+    }
+
+public:
+    explicit RejectLog(string p) : path(move(p)) {}
+
+    void write(const vector<CsvReject>& rejects) {
+        if (rejects.empty()) return;
+        if (!file.is_open()) {
+            file.open(path, ios::trunc);
+            if (!file) throw StudentException("Cannot create " + path);
+            file << "line,reason,row\n";
+        }
+        for (const CsvReject& r : rejects) {
+            file << r.line << ',';
+            quoted(file, r.reason);
+            file << ',';
+            quoted(file, r.row);
+            file << '\n';
+        }
+        written += rejects.size();
+        file.flush();
+        if (file.fail()) throw StudentException("Failed to write " + path);
+    }
+
+    size_t size() const { return written; }
+};
+
+struct ImportSummary {
+    size_t imported = 0;
+    size_t rejected = 0;
+};
+
+// ========== Roll Number Index ==========
+// Open-addressing hash map from roll number to slot in the students vector.
+// Linear probing with backward-shift deletion, so no tombstones build up.
+class RollIndex {
+private:
+    static const int EMPTY = -1;   // roll numbers are never negative
+
+    struct Entry {
+        int rollNo;
+        int slot;
+    };
+
+    vector<Entry> table;
+    size_t count = 0;
+
+    // Fibonacci hashing, keeping the high bits of the product (as shardOf
+    // does): the low bits of rollNo * 2654435769 repeat for roll numbers
+    // spaced by a power of two, which would pile them onto a few slots
+    size_t home(int rollNo) const {
+        uint32_t h = static_cast<uint32_t>(rollNo) * 2654435769u;
+        return static_cast<size_t>((uint64_t(h) * table.size()) >> 32);
+    }
+
+    size_t mask() const { return table.size() - 1; }
+
+    void rehash(size_t newCapacity) {
+        vector<Entry> old;
+        old.swap(table);
+        table.assign(newCapacity, Entry{EMPTY, -1});
+        count = 0;
+        for (const Entry& e : old) {
+            if (e.rollNo != EMPTY) insert(e.rollNo, e.slot);
+        }
+    }
+
+public:
+    RollIndex() { table.assign(16, Entry{EMPTY, -1}); }
+
+    size_t size() const { return count; }
+
+    void clear() {
+        table.assign(16, Entry{EMPTY, -1});
+        count = 0;
+    }
+
+    // Make room for n keys without further rehashing (load factor <= 0.5)
+    void reserve(size_t n) {
+        size_t capacity = 16;
+        while (capacity < n * 2) capacity <<= 1;
+        if (capacity > table.size()) rehash(capacity);
+    }
+
+    // Returns the slot for rollNo, or -1 if absent
+    int find(int rollNo) const {
+        for (size_t i = home(rollNo);; i = (i + 1) & mask()) {
+            if (table[i].rollNo == rollNo) return table[i].slot;
+            if (table[i].rollNo == EMPTY) return -1;
+        }
+    }
+
+    // Inserts or overwrites the slot for rollNo
+    void insert(int rollNo, int slot) {
+        if ((count + 1) * 2 > table.size()) rehash(table.size() * 2);
+        size_t i = home(rollNo);
+        while (table[i].rollNo != EMPTY && table[i].rollNo != rollNo) {
+            i = (i + 1) & mask();
+        }
+        if (table[i].rollNo == EMPTY) count++;
+        table[i] = Entry{rollNo, slot};
+    }
+
+    void erase(int rollNo) {
+        size_t i = home(rollNo);
+        while (table[i].rollNo != rollNo) {
+            if (table[i].rollNo == EMPTY) return;
+            i = (i + 1) & mask();
+        }
+        // Backward-shift: pull later entries of the probe chain into the hole
+        size_t hole = i;
+        for (size_t j = (hole + 1) & mask(); table[j].rollNo != EMPTY; j = (j + 1) & mask()) {
+            size_t start = home(table[j].rollNo);
+            if (((j - start) & mask()) >= ((j - hole) & mask())) {
+                table[hole] = table[j];
+                hole = j;
+            }
+        }
+        table[hole] = Entry{EMPTY, -1};
+        count--;
+    }
+};
+
+// ========== Marks Index ==========
+// Order-maintaining secondary index on (marks, rollNo) for range counts,
+// range listings and top-K. Entries live in sorted blocks of at most
+// 2 * BLOCK keys (a flat B+-tree leaf level) with a directory of block
+// maxima; a Fenwick tree over the block sizes gives any entry's rank in
+// O(log n). Inserts and erases touch one block plus O(log n) counters.
+struct MarksKey {
+    float marks;
+    int rollNo;
+
+    bool operator<(const MarksKey& o) const {
+        return marks < o.marks || (marks == o.marks && rollNo < o.rollNo);
+    }
+    bool operator==(const MarksKey& o) const { return marks == o.marks && rollNo == o.rollNo; }
+};
+
+class MarksIndex {
+private:
+    static const size_t BLOCK = 512;
+
+    vector<vector<MarksKey>> blocks;
+    vector<MarksKey> blockMax;   // last key of each block
+    vector<size_t> fenwick;      // 1-based tree over block sizes
+    size_t count = 0;
+
+    void rebuildDirectory() {
+        blockMax.resize(blocks.size());
+        fenwick.assign(blocks.size() + 1, 0);
+        for (size_t b = 0; b < blocks.size(); b++) {
+            blockMax[b] = blocks[b].back();
+            fenwick[b + 1] += blocks[b].size();
+            size_t parent = (b + 1) + ((b + 1) & (~(b + 1) + 1));
+            if (parent <= blocks.size()) fenwick[parent] += fenwick[b + 1];
+        }
+    }
+
+    void fenwickAdd(size_t block, long delta) {
+        for (size_t i = block + 1; i < fenwick.size(); i += i & (~i + 1)) fenwick[i] += delta;
+    }
+
+    // Total size of blocks [0, block)
+    size_t fenwickPrefix(size_t block) const {
+        size_t sum = 0;
+        for (size_t i = block; i > 0; i -= i & (~i + 1)) sum += fenwick[i];
+        return sum;
+    }
+
+    // Position of the first key >= k (or > k when `after`), as block/offset
+    pair<size_t, size_t> locate(const MarksKey& k, bool after) const {
+        auto blockIt = after ? upper_bound(blockMax.begin(), blockMax.end(), k)
+                             : lower_bound(blockMax.begin(), blockMax.end(), k);
+        size_t b = blockIt - blockMax.begin();
+        if (b == blocks.size()) return {b, 0};
+        const vector<MarksKey>& block = blocks[b];
+        auto it = after ? upper_bound(block.begin(), block.end(), k) : lower_bound(block.begin(), block.end(), k);
+        return {b, static_cast<size_t>(it - block.begin())};
+    }
+
+    size_t rankOf(pair<size_t, size_t> pos) const {
+        return pos.first == blocks.size() ? count : fenwickPrefix(pos.first) + pos.second;
+    }
+
+    static MarksKey lowest(float marks) { return MarksKey{marks, numeric_limits<int>::min()}; }
+    static MarksKey highest(float marks) { return MarksKey{marks, numeric_limits<int>::max()}; }
+
+public:
+    size_t size() const { return count; }
+
+    void clear() {
+        blocks.clear();
+        blockMax.clear();
+        fenwick.assign(1, 0);
+        count = 0;
+    }
+
+    // Bulk build: one sort instead of n inserts
+    void build(vector<MarksKey> keys) {
+        sort(keys.begin(), keys.end());
+        assignSorted(keys);
+    }
+
+    // Replace the contents with already sorted keys
+    void assignSorted(const vector<MarksKey>& keys) {
+        blocks.clear();
+        for (size_t i = 0; i < keys.size(); i += BLOCK) {
+            blocks.emplace_back(keys.begin() + i, keys.begin() + min(keys.size(), i + BLOCK));
+        }
+        count = keys.size();
+        rebuildDirectory();
+    }
+
+    void insert(const MarksKey& k) {
+        if (blocks.empty()) {
+            blocks.push_back({k});
+            count = 1;
+            rebuildDirectory();
+            return;
+        }
+        size_t b = min(locate(k, false).first, blocks.size() - 1);
+        vector<MarksKey>& block = blocks[b];
+        block.insert(lower_bound(block.begin(), block.end(), k), k);
+        count++;
+        if (block.size() > 2 * BLOCK) {
+            // Split the full block in two and renumber the directory
+            vector<MarksKey> upperHalf(block.begin() + BLOCK, block.end());
+            block.resize(BLOCK);
+            blocks.insert(blocks.begin() + b + 1, move(upperHalf));
+            rebuildDirectory();
+        }
+        else {
+            blockMax[b] = block.back();
+            fenwickAdd(b, 1);
+        }
+    }
+
+    // Erase and insert many keys at once. Small batches go key by key; from
+    // count/64 keys on, one merge over the whole index is cheaper.
+    void replace(vector<MarksKey> erased, vector<MarksKey> inserted) {
+        if ((erased.size() + inserted.size()) * 64 < count) {
+            for (const MarksKey& k : erased) erase(k);
+            for (const MarksKey& k : inserted) insert(k);
+            return;
+        }
+        sort(erased.begin(), erased.end());
+        sort(inserted.begin(), inserted.end());
+        vector<MarksKey> all;
+        all.reserve(count);
+        for (const vector<MarksKey>& block : blocks) all.insert(all.end(), block.begin(), block.end());
+        vector<MarksKey> kept;
+        kept.reserve(all.size());
+        set_difference(all.begin(), all.end(), erased.begin(), erased.end(), back_inserter(kept));
+        all.clear();
+        merge(kept.begin(), kept.end(), inserted.begin(), inserted.end(), back_inserter(all));
+        assignSorted(all);
+    }
+
+    void erase(const MarksKey& k) {
+        pair<size_t, size_t> pos = locate(k, false);
+        if (pos.first == blocks.size() || !(blocks[pos.first][pos.second] == k)) return;
+        vector<MarksKey>& block = blocks[pos.first];
+        block.erase(block.begin() + pos.second);
+        count--;
+        if (block.empty()) {
+            blocks.erase(blocks.begin() + pos.first);
+            rebuildDirectory();
+        }
+        else {
+            blockMax[pos.first] = block.back();
+            fenwickAdd(pos.first, -1);
+        }
+    }
+
+    // Number of entries with lo <= marks <= hi, in O(log n)
+    size_t countRange(float lo, float hi) const {
+        if (hi < lo) return 0;
+        return rankOf(locate(highest(hi), true)) - rankOf(locate(lowest(lo), false));
+    }
+
+    // Visit entries with lo <= marks <= hi in ascending order: O(log n + k)
+    template <typename F>
+    void forEachInRange(float lo, float hi, F&& visit) const {
+        pair<size_t, size_t> pos = locate(lowest(lo), false);
+        for (size_t b = pos.first, i = pos.second; b < blocks.size(); b++, i = 0) {
+            for (; i < blocks[b].size(); i++) {
+                if (blocks[b][i].marks > hi) return;
+                visit(blocks[b][i]);
+            }
+        }
+    }
+
+    // Visit the k highest entries in descending order: O(k)
+    template <typename F>
+    void forEachTop(size_t k, F&& visit) const {
+        for (size_t b = blocks.size(); b-- > 0 && k > 0;) {
+            for (size_t i = blocks[b].size(); i-- > 0 && k > 0; k--) {
+                visit(blocks[b][i]);
+            }
+        }
+    }
+};
+
+// ========== Name Index ==========
+// Trigram index over lower-cased names for substring and prefix search.
+// Every name contributes its trigrams plus one start-of-name trigram
+// (marker + first two bytes). A query looks up only its rarest trigram
+// and the caller verifies each candidate against the actual name, so
+// postings never need intersecting. Removal is lazy: stale postings are
+// filtered out by that verification and dropped by a rebuild once they
+// make up half of the index.
+class NameIndex {
+private:
+    static const char START = '\x01';
+
+    unordered_map<uint32_t, vector<int32_t>> postings;
+    size_t entries = 0;   // postings added since the last rebuild
+    size_t stale = 0;     // of which no longer describe a live name
+
+    static char fold(char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); }
+
+    static uint32_t key(char a, char b, char c) {
+        return (uint32_t(uint8_t(fold(a))) << 16) | (uint32_t(uint8_t(fold(b))) << 8) | uint8_t(fold(c));
+    }
+
+    template <typename F>
+    static void forEachTrigram(string_view name, F&& visit) {
+        if (name.size() >= 2) visit(key(START, name[0], name[1]));
+        for (size_t i = 0; i + 3 <= name.size(); i++) visit(key(name[i], name[i + 1], name[i + 2]));
+    }
+
+public:
+    void clear() {
+        postings.clear();
+        entries = 0;
+        stale = 0;
+    }
+
+    void add(int rollNo, string_view name) {
+        forEachTrigram(name, [&](uint32_t k) {
+            vector<int32_t>& list = postings[k];
+            // A name repeating a trigram needs only one posting for it
+            if (list.empty() || list.back() != rollNo) {
+                list.push_back(rollNo);
+                entries++;
+            }
+        });
+    }
+
+    void remove(string_view name) {
+        forEachTrigram(name, [&](uint32_t) { stale++; });
+    }
+
+    bool needsRebuild() const { return stale > 1024 && stale * 2 > entries; }
+
+    // The shortest posting list that any match must appear in, or nullptr
+    // if the query is too short to use the index (the caller scans instead)
+    const vector<int32_t>* candidates(string_view query, bool prefix) const {
+        static const vector<int32_t> none;
+        const vector<int32_t>* best = nullptr;
+        auto consider = [&](uint32_t k) {
+            auto it = postings.find(k);
+            const vector<int32_t>* list = it == postings.end() ? &none : &it->second;
+            if (!best || list->size() < best->size()) best = list;
+        };
+        if (prefix && query.size() >= 2) consider(key(START, query[0], query[1]));
+        for (size_t i = 0; i + 3 <= query.size(); i++) consider(key(query[i], query[i + 1], query[i + 2]));
+        return best;
+    }
+
+    // Case-insensitive match used to verify candidates
+    static bool matches(string_view name, string_view query, bool prefix) {
+        auto equalFolded = [](char a, char b) { return fold(a) == fold(b); };
+        if (prefix) {
+            return name.size() >= query.size() && equal(query.begin(), query.end(), name.begin(), equalFolded);
+        }
+        return search(name.begin(), name.end(), query.begin(), query.end(), equalFolded) != name.end();
+    }
+};
+
+// ========== Marks Aggregation Kernels ==========
+// One pass over a contiguous marks column computing everything
+// showStatistics needs. Sums are accumulated in double per block and the
+// block totals are added with Kahan compensation, so precision holds well
+// past the ~10M rows where a single float accumulator starts losing marks.
+struct MarksSummary {
+    size_t count = 0;
+    double sum = 0;
+    double sumSquares = 0;
+    float minMarks = 0;
+    float maxMarks = 0;
+
+    double mean() const { return count ? sum / count : 0.0; }
+    double variance() const {
+        if (count == 0) return 0.0;
+        double m = mean();
+        double v = sumSquares / count - m * m;
+        return v > 0 ? v : 0.0;
+    }
+};
+
+// The aggregates together with some percentiles, taken at one moment
+struct MarksReport {
+    MarksSummary summary;
+    vector<double> percentiles;
+};
+
+const size_t SUMMARY_BLOCK = 4096;   // elements per partial sum
+
+// Kahan-compensated running total of block partial sums
+struct CompensatedSum {
+    double total = 0, carry = 0;
+    void add(double x) {
+        double y = x - carry;
+        double t = total + y;
+        carry = (t - total) - y;
+        total = t;
+    }
+};
+
+MarksSummary summarizeMarksScalar(const float* marks, size_t n) {
+    MarksSummary s;
+    s.count = n;
+    if (n == 0) return s;
+    CompensatedSum sum, sumSquares;
+    float lo = marks[0], hi = marks[0];
+    for (size_t block = 0; block < n; block += SUMMARY_BLOCK) {
+        size_t end = min(n, block + SUMMARY_BLOCK);
+        double partial = 0, partialSquares = 0;
+        for (size_t i = block; i < end; i++) {
+            double m = marks[i];
+            partial += m;
+            partialSquares += m * m;
+            lo = min(lo, marks[i]);
+            hi = max(hi, marks[i]);
+        }
+        sum.add(partial);
+        sumSquares.add(partialSquares);
+    }
+    s.sum = sum.total;
+    s.sumSquares = sumSquares.total;
+    s.minMarks = lo;
+    s.maxMarks = hi;
+    return s;
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SMS_HAVE_AVX2_KERNEL 1
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+MarksSummary summarizeMarksAVX2(const float* marks, size_t n) {
+    MarksSummary s;
+    s.count = n;
+    if (n < 8) return summarizeMarksScalar(marks, n);
+
+    CompensatedSum sum, sumSquares;
+    __m256 lo = _mm256_loadu_ps(marks), hi = lo;
+    size_t vectorEnd = n - n % 8;
+    for (size_t block = 0; block < vectorEnd; block += SUMMARY_BLOCK) {
+        size_t end = min(vectorEnd, block + SUMMARY_BLOCK);
+        __m256d accLow = _mm256_setzero_pd(), accHigh = _mm256_setzero_pd();
+        __m256d sqLow = _mm256_setzero_pd(), sqHigh = _mm256_setzero_pd();
+        for (size_t i = block; i < end; i += 8) {
+            __m256 v = _mm256_loadu_ps(marks + i);
+            lo = _mm256_min_ps(lo, v);
+            hi = _mm256_max_ps(hi, v);
+            __m256d dLow = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+            __m256d dHigh = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+            accLow = _mm256_add_pd(accLow, dLow);
+            accHigh = _mm256_add_pd(accHigh, dHigh);
+            sqLow = _mm256_add_pd(sqLow, _mm256_mul_pd(dLow, dLow));
+            sqHigh = _mm256_add_pd(sqHigh, _mm256_mul_pd(dHigh, dHigh));
+        }
+        alignas(32) double lanes[4], squareLanes[4];
+        _mm256_store_pd(lanes, _mm256_add_pd(accLow, accHigh));
+        _mm256_store_pd(squareLanes, _mm256_add_pd(sqLow, sqHigh));
+        sum.add((lanes[0] + lanes[1]) + (lanes[2] + lanes[3]));
+        sumSquares.add((squareLanes[0] + squareLanes[1]) + (squareLanes[2] + squareLanes[3]));
+    }
+
+    alignas(32) float loLanes[8], hiLanes[8];
+    _mm256_store_ps(loLanes, lo);
+    _mm256_store_ps(hiLanes, hi);
+    s.minMarks = *min_element(loLanes, loLanes + 8);
+    s.maxMarks = *max_element(hiLanes, hiLanes + 8);
+    for (size_t i = vectorEnd; i < n; i++) {
+        sum.add(marks[i]);
+        sumSquares.add(double(marks[i]) * marks[i]);
+        s.minMarks = min(s.minMarks, marks[i]);
+        s.maxMarks = max(s.maxMarks, marks[i]);
+    }
+    s.sum = sum.total;
+    s.sumSquares = sumSquares.total;
+    return s;
+}
+#endif
+
+#if defined(__aarch64__)
+#define SMS_HAVE_NEON_KERNEL 1
+#include <arm_neon.h>
+
+MarksSummary summarizeMarksNEON(const float* marks, size_t n) {
+    MarksSummary s;
+    s.count = n;
+    if (n < 4) return summarizeMarksScalar(marks, n);
+
+    CompensatedSum sum, sumSquares;
+    float32x4_t lo = vld1q_f32(marks), hi = lo;
+    size_t vectorEnd = n - n % 4;
+    for (size_t block = 0; block < vectorEnd; block += SUMMARY_BLOCK) {
+        size_t end = min(vectorEnd, block + SUMMARY_BLOCK);
+        float64x2_t accLow = vdupq_n_f64(0), accHigh = vdupq_n_f64(0);
+        float64x2_t sqLow = vdupq_n_f64(0), sqHigh = vdupq_n_f64(0);
+        for (size_t i = block; i < end; i += 4) {
+            float32x4_t v = vld1q_f32(marks + i);
+            lo = vminq_f32(lo, v);
+            hi = vmaxq_f32(hi, v);
+            float64x2_t dLow = vcvt_f64_f32(vget_low_f32(v));
+            float64x2_t dHigh = vcvt_high_f64_f32(v);
+            accLow = vaddq_f64(accLow, dLow);
+            accHigh = vaddq_f64(accHigh, dHigh);
+            sqLow = vfmaq_f64(sqLow, dLow, dLow);
+            sqHigh = vfmaq_f64(sqHigh, dHigh, dHigh);
+        }
+        sum.add(vaddvq_f64(vaddq_f64(accLow, accHigh)));
+        sumSquares.add(vaddvq_f64(vaddq_f64(sqLow, sqHigh)));
+    }
+
+    s.minMarks = vminvq_f32(lo);
+    s.maxMarks = vmaxvq_f32(hi);
+    for (size_t i = vectorEnd; i < n; i++) {
+        sum.add(marks[i]);
+        sumSquares.add(double(marks[i]) * marks[i]);
+        s.minMarks = min(s.minMarks, marks[i]);
+        s.maxMarks = max(s.maxMarks, marks[i]);
+    }
+    s.sum = sum.total;
+    s.sumSquares = sumSquares.total;
+    return s;
+}
+#endif
+
+using SummarizeKernel = MarksSummary (*)(const float*, size_t);
+
+// Pick the widest kernel this CPU supports, once
+SummarizeKernel selectSummarizeKernel(const char** name = nullptr) {
+#if defined(SMS_HAVE_AVX2_KERNEL)
+    if (__builtin_cpu_supports("avx2")) {
+        if (name) *name = "avx2";
+        return summarizeMarksAVX2;
+    }
+#elif defined(SMS_HAVE_NEON_KERNEL)
+    if (name) *name = "neon";
+    return summarizeMarksNEON;
+#endif
+    if (name) *name = "scalar";
+    return summarizeMarksScalar;
+}
+
+MarksSummary summarizeMarks(const float* marks, size_t n) {
+    static const SummarizeKernel kernel = selectSummarizeKernel();
+    return kernel(marks, n);
+}
+
+// ========== Running Statistics ==========
+// Marks histogram with one bucket per hundredth, 0.00 .. 100.00; every
+// mark is counted in its nearest bucket. Marks that are not an exact
+// hundredth (33.333 from an import, say) are also kept sorted in their
+// bucket, so percentiles, bands and min/max come out as exact stored
+// values: a walk over the bucket counts, O(buckets), finds the bucket and
+// only that bucket is looked into.
+class MarksHistogram {
+public:
+    static const size_t BUCKETS = 10001;
+
+private:
+    vector<uint64_t> counts = vector<uint64_t>(BUCKETS);      // marks nearest b / 100
+    vector<uint64_t> exact = vector<uint64_t>(BUCKETS);       // of which exactly b / 100
+    vector<vector<float>> offGrid = vector<vector<float>>(BUCKETS);   // the others, sorted
+    uint64_t total = 0;
+    size_t lo = BUCKETS, hi = 0;   // lowest and highest non-empty bucket; lo > hi when none
+
+    static float gridValue(size_t b) { return static_cast<float>(b) / 100.0f; }
+
+    // Nearest bucket; marks outside [0, 100] (a damaged file) go to an end
+    static size_t bucketOf(float m) {
+        double scaled = double(m) * 100.0;
+        if (!(scaled > 0.0)) return 0;
+        if (scaled >= double(BUCKETS - 1)) return BUCKETS - 1;
+        return static_cast<size_t>(lround(scaled));
+    }
+
+    void counted(size_t b) {
+        counts[b]++;
+        total++;
+        lo = min(lo, b);
+        hi = max(hi, b);
+    }
+
+    // Off-grid marks of bucket b that sort below its grid value
+    size_t below(size_t b) const {
+        const vector<float>& others = offGrid[b];
+        return static_cast<size_t>(lower_bound(others.begin(), others.end(), gridValue(b)) - others.begin());
+    }
+
+    // The r-th smallest (0-based) mark in bucket b
+    float resolve(size_t b, uint64_t r) const {
+        size_t under = below(b);
+        if (r < under) return offGrid[b][r];
+        if (r < under + exact[b]) return gridValue(b);
+        return offGrid[b][r - exact[b]];
+    }
+
+public:
+    void clear() {
+        fill(counts.begin(), counts.end(), 0);
+        fill(exact.begin(), exact.end(), 0);
+        for (vector<float>& others : offGrid) others = vector<float>();
+        total = 0;
+        lo = BUCKETS;
+        hi = 0;
+    }
+
+    uint64_t size() const { return total; }
+
+    void add(float m) {
+        size_t b = bucketOf(m);
+        if (gridValue(b) == m) exact[b]++;
+        else offGrid[b].insert(upper_bound(offGrid[b].begin(), offGrid[b].end(), m), m);
+        counted(b);
+    }
+
+    // Bulk add: off-grid marks are appended, and each bucket sorted once
+    void addAll(const float* marks, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            size_t b = bucketOf(marks[i]);
+            if (gridValue(b) == marks[i]) exact[b]++;
+            else offGrid[b].push_back(marks[i]);
+            counted(b);
+        }
+        for (size_t b = lo; b <= hi && b < BUCKETS; b++) {
+            if (!is_sorted(offGrid[b].begin(), offGrid[b].end())) sort(offGrid[b].begin(), offGrid[b].end());
+        }
+    }
+
+    // Returns false (and changes nothing) if m was not counted
+    bool remove(float m) {
+        size_t b = bucketOf(m);
+        if (gridValue(b) == m) {
+            if (exact[b] == 0) return false;
+            exact[b]--;
+        }
+        else {
+            vector<float>& others = offGrid[b];
+            auto it = lower_bound(others.begin(), others.end(), m);
+            if (it == others.end() || *it != m) return false;
+            others.erase(it);
+        }
+        total--;
+        if (--counts[b] == 0) {
+            if (b == lo) while (lo < BUCKETS && counts[lo] == 0) lo++;
+            if (b == hi) while (hi > 0 && counts[hi] == 0) hi--;
+        }
+        return true;
+    }
+
+    // Both need size() > 0
+    float minValue() const { return resolve(lo, 0); }
+    float maxValue() const { return resolve(hi, counts[hi] - 1); }
+
+    // The k-th smallest mark (0-based, k < size())
+    float valueAtRank(uint64_t k) const {
+        for (size_t b = lo; b < hi; b++) {
+            if (k < counts[b]) return resolve(b, k);
+            k -= counts[b];
+        }
+        return resolve(hi, k);
+    }
+
+    // Percentile p in [0, 100], interpolated between the two nearest ranks
+    // (so the 50th is the usual median); 0 when empty
+    double percentile(double p) const {
+        if (total == 0) return 0.0;
+        double rank = p / 100.0 * double(total - 1);
+        uint64_t k = static_cast<uint64_t>(rank);
+        double low = valueAtRank(k);
+        double frac = rank - double(k);
+        return frac > 0 ? low + frac * (double(valueAtRank(k + 1)) - low) : low;
+    }
+
+    // Counts per band of `width` marks: [0, w), [w, 2w), ... with 100 in
+    // the last band. width is rounded to a whole number of hundredths.
+    vector<uint64_t> bands(float width) const {
+        size_t step = static_cast<size_t>(lround(double(width) * 100.0));
+        if (step == 0 || step > BUCKETS - 1) throw StudentException("Band width must be between 0.01 and 100");
+        size_t bandCount = (BUCKETS - 1 + step - 1) / step;
+        vector<uint64_t> out(bandCount);
+        for (size_t b = lo; b <= hi && b < BUCKETS; b++) {
+            size_t band = min(b / step, bandCount - 1);
+            out[band] += counts[b];
+            // Marks just under a band's first hundredth belong to the band before
+            if (b % step == 0 && band > 0 && b / step == band) {
+                size_t under = below(b);
+                out[band] -= under;
+                out[band - 1] += under;
+            }
+        }
+        return out;
+    }
+};
+
+// Aggregates kept up to date on every mutation so showStatistics is O(1):
+// compensated running sum and sum of squares, plus the marks histogram
+// for the min, max and percentiles.
+class RunningStats {
+private:
+    size_t count = 0;
+    CompensatedSum sum, sumSquares;
+    MarksHistogram values;
+
+public:
+    void clear() {
+        count = 0;
+        sum = CompensatedSum();
+        sumSquares = CompensatedSum();
+        values.clear();
+    }
+
+    // Bulk initialisation from a marks column
+    void build(const float* marks, size_t n) {
+        clear();
+        addColumn(marks, n);
+    }
+
+    // Fold in a whole column at once (one per shard of a sharded roster)
+    void addColumn(const float* marks, size_t n) {
+        MarksSummary s = summarizeMarks(marks, n);
+        count += n;
+        sum.add(s.sum);
+        sumSquares.add(s.sumSquares);
+        values.addAll(marks, n);
+    }
+
+    void add(float m) {
+        count++;
+        sum.add(m);
+        sumSquares.add(double(m) * m);
+        values.add(m);
+    }
+
+    void remove(float m) {
+        if (!values.remove(m)) return;
+        count--;
+        sum.add(-double(m));
+        sumSquares.add(-double(m) * m);
+    }
+
+    void replace(float oldMarks, float newMarks) {
+        if (oldMarks == newMarks) return;
+        remove(oldMarks);
+        add(newMarks);
+    }
+
+    // Many replace() calls in one pass; histogram updates are O(1) each
+    void replaceAll(const vector<float>& removed, const vector<float>& added) {
+        for (float m : removed) remove(m);
+        for (float m : added) add(m);
+    }
+
+    MarksSummary summary() const {
+        MarksSummary s;
+        s.count = count;
+        if (count == 0) return s;
+        s.sum = sum.total;
+        s.sumSquares = sumSquares.total;
+        s.minMarks = values.minValue();
+        s.maxMarks = values.maxValue();
+        return s;
+    }
+
+    double percentile(double p) const { return values.percentile(p); }
+    vector<uint64_t> bands(float width) const { return values.bands(width); }
+};
+
+// ========== Write-Ahead Journal ==========
+// Append-only log of add/update/delete operations, replayed on top of
+// students.dat at startup. Entry layout:
+//   uint32 bodyLength | body | uint32 crc32(body)
+//   body = uint64 seq | uint8 op | int32 rollNo | float marks | name bytes
+const char* const DATA_FILE = "students.dat";
+const char* const JOURNAL_FILE = "students.journal";
+const char* const OLD_JOURNAL_FILE = "students.journal.old";   // being compacted
+const uint64_t JOURNAL_COMPACT_BYTES = 4 * 1024 * 1024;
+
+// Begin opens a transaction: its rollNo field holds how many Update
+// entries follow, and replay applies them all or none
+enum class JournalOp : uint8_t { Add = 1, Update = 2, Delete = 3, Begin = 4 };
+
+struct JournalEntry {
+    uint64_t seq;
+    JournalOp op;
+    int rollNo;
+    float marks;
+    string name;
+};
+
+uint32_t crc32(const char* data, size_t length) {
+    static const auto table = [] {
+        array<uint32_t, 256> t;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// Force a file's data to stable storage (flush-only where fsync is unavailable)
+void syncFile(const string& path) {
+#ifdef SMS_HAVE_FSYNC
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw StudentException("Cannot open " + path + " to sync");
+    int rc = fsync(fd);
+    ::close(fd);
+    if (rc != 0) throw StudentException("Failed to sync " + path);
+#else
+    (void)path;
+#endif
+}
+
+class Journal {
+private:
+    string path;
+    ofstream file;
+    string pending;              // encoded entries not yet written
+    size_t pendingEntries = 0;
+    size_t syncBatch = DEFAULT_SYNC_BATCH;
+    uint64_t bytesOnDisk = 0;
+    uint64_t appendedSeq = 0;    // newest entry appended ...
+    uint64_t syncedSeq = 0;      // ... and newest on disk
+
+    template <typename T>
+    static void put(string& out, const T& value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    static T get(const char* p) {
+        T value;
+        copy(p, p + sizeof(T), reinterpret_cast<char*>(&value));
+        return value;
+    }
+
+    static const size_t BODY_FIXED = sizeof(uint64_t) + sizeof(uint8_t) + sizeof(int32_t) + sizeof(float);
+
+public:
+    // Frame one entry onto `out`; replication ships the same frames
+    static void encode(string& out, uint64_t seq, JournalOp op, int rollNo, float marks, string_view name) {
+        put(out, static_cast<uint32_t>(BODY_FIXED + name.size()));
+        size_t bodyStart = out.size();
+        put(out, seq);
+        put(out, static_cast<uint8_t>(op));
+        put(out, static_cast<int32_t>(rollNo));
+        put(out, marks);
+        out.append(name.data(), name.size());
+        put(out, crc32(out.data() + bodyStart, out.size() - bodyStart));
+    }
+
+    // Length of the frame starting at `data`, header and checksum included,
+    // or 0 if there is not even a header yet
+    static size_t frameLength(const char* data, size_t size) {
+        if (size < sizeof(uint32_t)) return 0;
+        return sizeof(uint32_t) + size_t(get<uint32_t>(data)) + sizeof(uint32_t);
+    }
+
+    // A zero length word, which no frame starts with; the replication
+    // stream sends it as a heartbeat
+    static constexpr size_t HEARTBEAT_BYTES = sizeof(uint32_t);
+    static bool isHeartbeat(const char* data, size_t size) {
+        return size >= HEARTBEAT_BYTES && get<uint32_t>(data) == 0;
+    }
+
+    // Decode a complete frame; false if it is malformed or fails its checksum
+    static bool decode(const char* frame, size_t length, JournalEntry& e) {
+        if (length < BODY_FIXED + 2 * sizeof(uint32_t) || frameLength(frame, length) != length) return false;
+        const char* body = frame + sizeof(uint32_t);
+        size_t bodyLength = length - 2 * sizeof(uint32_t);
+        if (get<uint32_t>(body + bodyLength) != crc32(body, bodyLength)) return false;
+        e.seq = get<uint64_t>(body);
+        e.op = static_cast<JournalOp>(get<uint8_t>(body + 8));
+        e.rollNo = get<int32_t>(body + 9);
+        e.marks = get<float>(body + 13);
+        e.name.assign(body + BODY_FIXED, bodyLength - BODY_FIXED);
+        return true;
+    }
+
+    // Entries are fsync'd together once this many are pending, or on sync()
+    static const size_t DEFAULT_SYNC_BATCH = 64;
+
+    // 0 disables automatic syncing; entries then wait for an explicit sync()
+    void setSyncBatch(size_t entries) { syncBatch = entries; }
+    size_t syncBatchSize() const { return syncBatch; }
+
+    ~Journal() {
+        try { close(); } catch (...) {}
+    }
+
+    void open(const string& journalPath) {
+        path = journalPath;
+        file.open(path, ios::binary | ios::app);
+        if (!file) throw StudentException("Cannot open journal file");
+        bytesOnDisk = filesystem::file_size(path);
+    }
+
+    void close() {
+        if (!file.is_open()) return;
+        sync();
+        file.close();
+    }
+
+    // Drop every entry; used once they have been folded into students.dat
+    void reset() {
+        pending.clear();
+        pendingEntries = 0;
+        file.close();
+        file.open(path, ios::binary | ios::trunc);
+        if (!file) throw StudentException("Cannot open journal file");
+        syncFile(path);
+        bytesOnDisk = 0;
+        syncedSeq = appendedSeq;   // dropped entries are in students.dat now
+    }
+
+    // Encodes straight into the pending buffer; no per-entry allocation
+    void append(uint64_t seq, JournalOp op, int rollNo, float marks, string_view name) {
+        encode(pending, seq, op, rollNo, marks, name);
+        appendedSeq = seq;
+        if (++pendingEntries >= syncBatch && syncBatch != 0) sync();
+    }
+
+    // Write all pending entries and fsync them as one batch
+    void sync() {
+        if (pending.empty()) return;
+        file.write(pending.data(), pending.size());
+        file.flush();
+        if (file.fail()) throw StudentException("Failed to write journal");
+        syncFile(path);
+        SMS_COUNT_BYTES(bytesWritten, pending.size());
+        bytesOnDisk += pending.size();
+        pending.clear();
+        pendingEntries = 0;
+        syncedSeq = appendedSeq;
+    }
+
+    uint64_t size() const { return bytesOnDisk + pending.size(); }
+
+    // Newest entry made durable by sync() in this session (0 if none yet)
+    uint64_t durableSeq() const { return syncedSeq; }
+
+    // Read every intact entry. A torn or corrupt tail (e.g. from a crash
+    // mid-write) ends the replay and is cut off so new entries follow the
+    // last good one; so is a transaction the tail has left incomplete.
+    static vector<JournalEntry> readAll(const string& journalPath) {
+        vector<JournalEntry> entries;
+        ifstream in(journalPath, ios::binary);
+        if (!in) return entries;
+        string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        in.close();
+
+        size_t pos = 0;
+        size_t groupPos = 0, groupFirst = 0, groupRemaining = 0;   // open transaction
+        for (;;) {
+            size_t length = frameLength(data.data() + pos, data.size() - pos);
+            JournalEntry e;
+            if (length == 0 || length > data.size() - pos || !decode(data.data() + pos, length, e)) break;
+            if (e.op == JournalOp::Begin && e.rollNo > 0) {
+                groupPos = pos;
+                groupFirst = entries.size();
+                groupRemaining = static_cast<size_t>(e.rollNo);
+            }
+            else if (groupRemaining > 0) {
+                groupRemaining--;
+            }
+            entries.push_back(move(e));
+            pos += length;
+        }
+        if (groupRemaining > 0) {
+            entries.resize(groupFirst);
+            pos = groupPos;
+        }
+        if (pos != data.size()) {
+            cout << "Warning: discarding " << (data.size() - pos) << " bytes of damaged journal data." << endl;
+            filesystem::resize_file(journalPath, pos);
+        }
+        return entries;
+    }
+};
+
+// Write a full snapshot to a temporary file and atomically rename it over
+// `path`, so a crash mid-save never leaves a half-written data file.
+void writeSnapshot(const StudentStore& students, uint64_t journalSeq, const string& path = DATA_FILE) {
+    string tmp = path + ".tmp";
+    DoubleBufferedWriter file(tmp);
+    writeBinary(file, students, journalSeq);
+    file.close();
+    syncFile(tmp);
+    SMS_COUNT_BYTES(bytesWritten, filesystem::file_size(tmp));
+    filesystem::rename(tmp, path);
+}
+
+// ========== Replication Backlog ==========
+// The newest journal frames, kept in memory so a primary can stream
+// followers the changes they are missing (see Server and Replica). Frames
+// are grouped into commits: one change, a whole GRADES transaction or an
+// import batch. A follower always stops at the end of a commit, so it
+// asks to resume from one. Past the byte limit the oldest commits are
+// dropped; a follower that needs them starts over from a snapshot.
+const size_t REPLICATION_BACKLOG_BYTES = 16 * 1024 * 1024;
+
+class ReplicationLog {
+private:
+    string frames;
+    vector<pair<uint64_t, size_t>> commits;   // (last seq, end offset in frames)
+    uint64_t baseSeq = 0;                     // newest change before frames[0]
+    size_t limit = 0;                         // 0: disabled, nothing is kept
+
+public:
+    bool enabled() const { return limit != 0; }
+
+    // Start keeping frames; changes up to `seq` are not in the backlog
+    void enable(uint64_t seq, size_t bytes) {
+        limit = bytes;
+        reset(seq);
+    }
+
+    // The history was replaced (a snapshot was installed at `seq`)
+    void reset(uint64_t seq) {
+        frames.clear();
+        commits.clear();
+        baseSeq = seq;
+    }
+
+    void append(uint64_t seq, JournalOp op, int rollNo, float marks, string_view name) {
+        if (enabled()) Journal::encode(frames, seq, op, rollNo, marks, name);
+    }
+
+    // Close the commit ending with change `seq`
+    void commit(uint64_t seq) {
+        if (!enabled() || (!commits.empty() && commits.back().second == frames.size())) return;
+        commits.emplace_back(seq, frames.size());
+        if (frames.size() <= limit) return;
+        // Keep the newest half, so trimming costs O(1) per byte appended
+        size_t drop = 0;
+        while (drop + 1 < commits.size() && frames.size() - commits[drop].second > limit / 2) drop++;
+        size_t bytes = commits[drop].second;
+        baseSeq = commits[drop].first;
+        frames.erase(0, bytes);
+        commits.erase(commits.begin(), commits.begin() + drop + 1);
+        for (auto& c : commits) c.second -= bytes;
+    }
+
+    // Append to `out` the frames of the commits after `seq`, up to
+    // `upTo` (whole commits only, and at most about maxBytes), and advance
+    // `seq` past them. False if `seq` is not a commit boundary the backlog
+    // still holds.
+    bool readAfter(uint64_t& seq, uint64_t upTo, string& out, size_t maxBytes) const {
+        size_t begin;
+        auto it = lower_bound(commits.begin(), commits.end(), make_pair(seq, size_t(0)));
+        if (seq == baseSeq) {
+            begin = 0;
+            it = commits.begin();
+        }
+        else if (it != commits.end() && it->first == seq) {
+            begin = it->second;
+            ++it;
+        }
+        else {
+            return false;
+        }
+        size_t end = begin;
+        for (; it != commits.end() && it->first <= upTo; ++it) {
+            if (end > begin && it->second - begin > maxBytes) break;
+            end = it->second;
+            seq = it->first;
+        }
+        out.append(frames, begin, end - begin);
+        return true;
+    }
+};
+
+// ========== Compressed File Format ==========
+// Compact alternative to the binary format for backups and copies
+// (--storage compressed). Records are sorted by roll number and cut into
+// blocks of PACKED_BLOCK_ROWS that decode independently:
+//   PackedHeader
+//   PackedBlockInfo directory[blockCount]
+//   block data
+// In a block, roll numbers are varint gaps from the previous one; marks are
+// varints in hundredths when every mark in the block survives that exactly
+// (raw floats otherwise); names are LZ-compressed. Blocks are encoded and
+// decoded in parallel, and the directory lets a reader decode only the
+// block holding a given roll number.
+const char PACKED_MAGIC[4] = {'S', 'M', 'S', 'Z'};
+const uint32_t PACKED_VERSION = 1;
+const size_t PACKED_BLOCK_ROWS = 4096;
+
+struct PackedHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t count;
+    uint64_t journalSeq;
+    uint64_t blockCount;
+};
+
+struct PackedBlockInfo {
+    int32_t firstRollNo;
+    uint32_t rows;
+    uint64_t offset;   // from the start of the file
+    uint32_t bytes;
+    uint32_t crc;
+};
+
+void putVarint(string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>(v | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+uint64_t getVarint(const char*& p, const char* end) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end) throw StudentException("Corrupted data in file");
+        uint8_t b = static_cast<uint8_t>(*p++);
+        v |= uint64_t(b & 0x7F) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    throw StudentException("Corrupted data in file");
+}
+
+// LZ77 after LZ4's sequence layout: a token byte holds the literal count
+// (high nibble) and match length - 4 (low nibble), 15 meaning more length
+// bytes follow; then the literals and a 2-byte match offset. The final
+// sequence is literals only. Matching is greedy through a small hash table.
+const size_t LZ_MIN_MATCH = 4;
+
+void lzPutLength(string& out, size_t extra) {
+    for (; extra >= 255; extra -= 255) out += static_cast<char>(255);
+    out += static_cast<char>(extra);
+}
+
+void lzSequence(string& out, string_view literals, size_t matchLength, size_t offset) {
+    size_t match = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+    out += static_cast<char>((min<size_t>(literals.size(), 15) << 4) | min<size_t>(match, 15));
+    if (literals.size() >= 15) lzPutLength(out, literals.size() - 15);
+    out.append(literals.data(), literals.size());
+    if (matchLength == 0) return;
+    out += static_cast<char>(offset & 0xFF);
+    out += static_cast<char>(offset >> 8);
+    if (match >= 15) lzPutLength(out, match - 15);
+}
+
+string lzCompress(string_view in) {
+    const int HASH_BITS = 12;
+    const size_t MAX_OFFSET = 65535;
+    const uint32_t NONE = numeric_limits<uint32_t>::max();
+    vector<uint32_t> table(size_t(1) << HASH_BITS, NONE);
+    string out;
+    out.reserve(in.size() / 2 + 16);
+    size_t anchor = 0, i = 0;
+    while (i + LZ_MIN_MATCH <= in.size()) {
+        uint32_t word;
+        memcpy(&word, in.data() + i, sizeof(word));
+        uint32_t h = (word * 2654435761u) >> (32 - HASH_BITS);
+        uint32_t candidate = table[h];
+        table[h] = static_cast<uint32_t>(i);
+        if (candidate == NONE || i - candidate > MAX_OFFSET || memcmp(in.data() + candidate, in.data() + i, LZ_MIN_MATCH) != 0) {
+            i++;
+            continue;
+        }
+        size_t length = LZ_MIN_MATCH;
+        while (i + length < in.size() && in[candidate + length] == in[i + length]) length++;
+        lzSequence(out, in.substr(anchor, i - anchor), length, i - candidate);
+        i += length;
+        anchor = i;
+    }
+    lzSequence(out, in.substr(anchor), 0, 0);
+    return out;
+}
+
+string lzDecompress(const char* p, const char* end, size_t rawSize) {
+    auto length = [&](size_t n) {
+        if (n == 15) {
+            for (uint8_t b = 255; b == 255; n += b) {
+                if (p == end) throw StudentException("Corrupted data in file");
+                b = static_cast<uint8_t>(*p++);
+            }
+        }
+        return n;
+    };
+    string out;
+    out.reserve(rawSize);
+    while (p < end) {
+        uint8_t token = static_cast<uint8_t>(*p++);
+        size_t literals = length(token >> 4);
+        if (size_t(end - p) < literals || out.size() + literals > rawSize) throw StudentException("Corrupted data in file");
+        out.append(p, literals);
+        p += literals;
+        if (p == end) break;   // final sequence
+        if (end - p < 2) throw StudentException("Corrupted data in file");
+        size_t offset = static_cast<uint8_t>(p[0]) | size_t(static_cast<uint8_t>(p[1])) << 8;
+        p += 2;
+        size_t match = length(token & 15) + LZ_MIN_MATCH;
+        if (offset == 0 || offset > out.size() || out.size() + match > rawSize) {
+            throw StudentException("Corrupted data in file");
+        }
+        size_t from = out.size() - offset;
+        for (size_t k = 0; k < match; k++) out += out[from + k];   // may overlap itself
+    }
+    if (out.size() != rawSize) throw StudentException("Corrupted data in file");
+    return out;
+}
+
+float packedMarks(uint64_t hundredths) { return static_cast<float>(hundredths) / 100.0f; }
+
+// Encode the records at order[begin, end), sorted by roll number
+string encodePackedBlock(const StudentStore& students, const vector<uint32_t>& order, size_t begin, size_t end) {
+    string block;
+    int previous = 0;
+    for (size_t k = begin; k < end; k++) {
+        int rollNo = students.rollNoAt(order[k]);
+        putVarint(block, static_cast<uint64_t>(rollNo - (k == begin ? 0 : previous)));
+        previous = rollNo;
+    }
+
+    bool hundredths = all_of(order.begin() + begin, order.begin() + end, [&](uint32_t i) {
+        float m = students.marksAt(i);
+        return packedMarks(static_cast<uint64_t>(lround(m * 100.0))) == m;
+    });
+    block += static_cast<char>(hundredths);
+    for (size_t k = begin; k < end; k++) {
+        float m = students.marksAt(order[k]);
+        if (hundredths) putVarint(block, static_cast<uint64_t>(lround(m * 100.0)));
+        else block.append(reinterpret_cast<const char*>(&m), sizeof(m));
+    }
+
+    string names;
+    for (size_t k = begin; k < end; k++) {
+        string_view name = students.nameAt(order[k]);
+        putVarint(block, name.size());
+        names.append(name.data(), name.size());
+    }
+    string packed = lzCompress(names);
+    putVarint(block, names.size());
+    putVarint(block, packed.size());
+    block += packed;
+    return block;
+}
+
+// Decode a block's roll numbers into rollNos[rows]; returns where the
+// marks start
+const char* decodePackedRolls(const char* p, const char* end, size_t rows, int32_t* rollNos) {
+    int64_t rollNo = 0;
+    for (size_t k = 0; k < rows; k++) {
+        uint64_t gap = getVarint(p, end);
+        if ((k > 0 && gap == 0) || gap > uint64_t(numeric_limits<int>::max()) - rollNo) {
+            throw StudentException("Corrupted data in file");
+        }
+        rollNo += static_cast<int64_t>(gap);
+        rollNos[k] = static_cast<int32_t>(rollNo);
+    }
+    return p;
+}
+
+void decodePackedBlock(const char* p, const char* end, size_t rows, StudentStore& out) {
+    vector<int32_t> rollNos(rows);
+    vector<float> marks(rows);
+    vector<size_t> nameLengths(rows);
+    p = decodePackedRolls(p, end, rows, rollNos.data());
+    if (p == end) throw StudentException("Corrupted data in file");
+    bool hundredths = *p++ != 0;
+    for (size_t k = 0; k < rows; k++) {
+        if (hundredths) {
+            marks[k] = packedMarks(getVarint(p, end));
+        }
+        else {
+            if (size_t(end - p) < sizeof(float)) throw StudentException("Corrupted data in file");
+            memcpy(&marks[k], p, sizeof(float));
+            p += sizeof(float);
+        }
+        if (!Student::validMarks(marks[k])) throw StudentException("Corrupted data in file");
+    }
+    uint64_t nameBytes = 0;
+    for (size_t& length : nameLengths) {
+        length = static_cast<size_t>(getVarint(p, end));
+        nameBytes += length;
+    }
+    uint64_t rawSize = getVarint(p, end), packedSize = getVarint(p, end);
+    if (rawSize != nameBytes || packedSize != uint64_t(end - p)) throw StudentException("Corrupted data in file");
+    string names = lzDecompress(p, end, static_cast<size_t>(rawSize));
+
+    out.reserve(out.size() + rows);
+    size_t offset = 0;
+    for (size_t k = 0; k < rows; k++) {
+        out.append(string_view(names).substr(offset, nameLengths[k]), rollNos[k], marks[k]);
+        offset += nameLengths[k];
+    }
+}
+
+// One block of a compressed file, decoded by the first read that needs it.
+// Blocks share the mapping, so a snapshot can go on reading one after the
+// roster that handed it out is closed.
+class PackedBlock {
+private:
+    shared_ptr<const MappedFile> file;
+    PackedBlockInfo info;
+    mutable once_flag decodedOnce;
+    mutable StudentStore decoded;
+
+public:
+    PackedBlock(shared_ptr<const MappedFile> f, const PackedBlockInfo& i) : file(move(f)), info(i) {}
+
+    static void decode(const MappedFile& file, const PackedBlockInfo& info, StudentStore& out) {
+        const char* p = file.data() + info.offset;
+        if (crc32(p, info.bytes) != info.crc) throw StudentException("Corrupted data in file");
+        decodePackedBlock(p, p + info.bytes, info.rows, out);
+    }
+
+    const StudentStore& records() const {
+        call_once(decodedOnce, [&] {
+            StudentStore s;
+            decode(*file, info, s);
+            decoded = move(s);
+        });
+        return decoded;
+    }
+};
+
+// Read side: the file is mapped and only the header and directory are
+// checked up front; each block is checksummed when it is decoded.
+// The loader goes one step further with loadRollNumbers(): it decodes only
+// the roll numbers (a varint pass per block) and leaves names and marks to
+// be decoded a block at a time by the first read that needs them. Slot i
+// is record i in roll number order, in block i / PACKED_BLOCK_ROWS.
+class PackedRoster {
+private:
+    shared_ptr<MappedFile> file;
+    PackedHeader header = {};
+    vector<PackedBlockInfo> blocks;
+    vector<int32_t> rollNos;                      // every roll number, ascending
+    vector<shared_ptr<const PackedBlock>> decoded;
+    bool ready = false;                           // loadRollNumbers() done
+
+public:
+    void open(const string& path) {
+        file = make_shared<MappedFile>();
+        if (!file->open(path)) throw StudentException("Cannot map data file");
+        if (file->size() < sizeof(header)) throw StudentException("Truncated file header");
+        memcpy(&header, file->data(), sizeof(header));
+        if (!equal(PACKED_MAGIC, PACKED_MAGIC + 4, header.magic) || header.version != PACKED_VERSION) {
+            throw StudentException("Unsupported compressed file version " + to_string(header.version));
+        }
+        if (header.blockCount > (file->size() - sizeof(header)) / sizeof(PackedBlockInfo)) {
+            throw StudentException("Corrupted data in file");
+        }
+        blocks.resize(header.blockCount);
+        memcpy(blocks.data(), file->data() + sizeof(header), blocks.size() * sizeof(PackedBlockInfo));
+        // Every block but the last is full, and the last is not empty
+        uint64_t rows = 0;
+        for (size_t b = 0; b < blocks.size(); b++) {
+            const PackedBlockInfo& info = blocks[b];
+            if (info.offset > file->size() || info.bytes > file->size() - info.offset) throw StudentException("Corrupted data in file");
+            if (info.rows == 0 || info.rows > PACKED_BLOCK_ROWS || (b + 1 < blocks.size() && info.rows != PACKED_BLOCK_ROWS)) {
+                throw StudentException("Corrupted data in file");
+            }
+            rows += info.rows;
+        }
+        if (rows != header.count) throw StudentException("Corrupted data in file");
+    }
+
+    // Decode every block's roll numbers in parallel and check they ascend
+    // across the file; after this the record accessors below work
+    void loadRollNumbers() {
+        rollNos.resize(size());
+        size_t workers = min<size_t>(workerCount(), blocks.size());
+        parallelFor(workers, [&](size_t w) {
+            for (size_t b = w; b < blocks.size(); b += workers) {
+                const char* p = file->data() + blocks[b].offset;
+                int32_t* out = rollNos.data() + b * PACKED_BLOCK_ROWS;
+                decodePackedRolls(p, p + blocks[b].bytes, blocks[b].rows, out);
+                if (out[0] != blocks[b].firstRollNo) throw StudentException("Corrupted data in file");
+            }
+        });
+        for (size_t b = 1; b < blocks.size(); b++) {
+            size_t first = b * PACKED_BLOCK_ROWS;
+            if (rollNos[first] <= rollNos[first - 1]) throw StudentException("Corrupted data in file");
+        }
+        decoded.clear();
+        decoded.reserve(blocks.size());
+        for (const PackedBlockInfo& b : blocks) decoded.push_back(make_shared<const PackedBlock>(file, b));
+        ready = true;
+    }
+
+    void close() {
+        decoded = vector<shared_ptr<const PackedBlock>>();
+        rollNos = vector<int32_t>();
+        blocks.clear();
+        header = PackedHeader();
+        file.reset();
+        ready = false;
+    }
+
+    bool isOpen() const { return ready; }
+    size_t size() const { return header.count; }
+    size_t blockCount() const { return blocks.size(); }
+    uint64_t lastJournalSeq() const { return header.journalSeq; }
+
+    // Block b, decoded on first use
+    const StudentStore& block(size_t b) const { return decoded[b]->records(); }
+    shared_ptr<const PackedBlock> sharedBlock(size_t b) const { return decoded[b]; }
+
+    int rollNoAt(size_t i) const { return rollNos[i]; }
+    float marksAt(size_t i) const { return block(i / PACKED_BLOCK_ROWS).marksAt(i % PACKED_BLOCK_ROWS); }
+    string_view nameAt(size_t i) const { return block(i / PACKED_BLOCK_ROWS).nameAt(i % PACKED_BLOCK_ROWS); }
+
+    // Slot of rollNo, or -1
+    int indexOf(int rollNo) const {
+        auto it = lower_bound(rollNos.begin(), rollNos.end(), rollNo);
+        return it != rollNos.end() && *it == rollNo ? static_cast<int>(it - rollNos.begin()) : -1;
+    }
+
+    void decodeBlock(size_t b, StudentStore& out) const { PackedBlock::decode(*file, blocks[b], out); }
+
+    // Every block, decoded in parallel; one store per block, in roll order
+    vector<StudentStore> decodeAll() const {
+        vector<StudentStore> stores(blocks.size());
+        size_t workers = min<size_t>(workerCount(), blocks.size());
+        parallelFor(workers, [&](size_t w) {
+            for (size_t b = w; b < blocks.size(); b += workers) decodeBlock(b, stores[b]);
+        });
+        return stores;
+    }
+
+    // Decodes only the block that can hold rollNo
+    optional<Student> find(int rollNo) const {
+        auto it = upper_bound(blocks.begin(), blocks.end(), rollNo,
+                              [](int r, const PackedBlockInfo& b) { return r < b.firstRollNo; });
+        if (it == blocks.begin()) return nullopt;
+        StudentStore block;
+        decodeBlock(static_cast<size_t>(it - blocks.begin()) - 1, block);
+        const int32_t* rolls = block.rollNoColumn();
+        const int32_t* hit = lower_bound(rolls, rolls + block.size(), rollNo);
+        if (hit == rolls + block.size() || *hit != rollNo) return nullopt;
+        size_t i = static_cast<size_t>(hit - rolls);
+        return Student(string(block.nameAt(i)), rollNo, block.marksAt(i));
+    }
+};
+
+// Same contract as writeSnapshot, in the compressed format
+void writePackedSnapshot(const StudentStore& students, uint64_t journalSeq, const string& path = DATA_FILE) {
+    vector<uint32_t> order;
+    order.reserve(students.liveCount());
+    for (size_t i = 0; i < students.size(); i++) {
+        if (students.isLive(i)) order.push_back(static_cast<uint32_t>(i));
+    }
+    sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return students.rollNoAt(a) < students.rollNoAt(b); });
+
+    size_t blockCount = (order.size() + PACKED_BLOCK_ROWS - 1) / PACKED_BLOCK_ROWS;
+    vector<string> encoded(blockCount);
+    size_t workers = min<size_t>(workerCount(), blockCount);
+    parallelFor(workers, [&](size_t w) {
+        for (size_t b = w; b < blockCount; b += workers) {
+            size_t begin = b * PACKED_BLOCK_ROWS;
+            encoded[b] = encodePackedBlock(students, order, begin, min(order.size(), begin + PACKED_BLOCK_ROWS));
+        }
+    });
+
+    PackedHeader header = {};
+    copy(PACKED_MAGIC, PACKED_MAGIC + 4, header.magic);
+    header.version = PACKED_VERSION;
+    header.count = order.size();
+    header.journalSeq = journalSeq;
+    header.blockCount = blockCount;
+    vector<PackedBlockInfo> directory(blockCount);
+    uint64_t offset = sizeof(header) + blockCount * sizeof(PackedBlockInfo);
+    for (size_t b = 0; b < blockCount; b++) {
+        if (encoded[b].size() > numeric_limits<uint32_t>::max()) throw StudentException("Block too large");
+        directory[b].firstRollNo = students.rollNoAt(order[b * PACKED_BLOCK_ROWS]);
+        directory[b].rows = static_cast<uint32_t>(min(PACKED_BLOCK_ROWS, order.size() - b * PACKED_BLOCK_ROWS));
+        directory[b].offset = offset;
+        directory[b].bytes = static_cast<uint32_t>(encoded[b].size());
+        directory[b].crc = crc32(encoded[b].data(), encoded[b].size());
+        offset += encoded[b].size();
+    }
+
+    string tmp = path + ".tmp";
+    DoubleBufferedWriter file(tmp);
+    file.write(&header, sizeof(header));
+    file.write(directory.data(), directory.size() * sizeof(PackedBlockInfo));
+    for (const string& block : encoded) file.write(block.data(), block.size());
+    file.close();
+    syncFile(tmp);
+    SMS_COUNT_BYTES(bytesWritten, filesystem::file_size(tmp));
+    filesystem::rename(tmp, path);
+}
+
+// ========== Sharded Storage ==========
+// A roster too big for one file is split across N binary data files by a
+// hash of the roll number, tied together by students.manifest:
+//   SMS-SHARDS 1
+//   <shards> <generation> <journalSeq>
+//   <file> <count>            one line per shard
+// Every shard is an ordinary binary data file with its records sorted by
+// roll number. A save writes a new generation of shard files in parallel
+// and then renames the manifest into place, which is the commit point;
+// files of the previous layout are deleted only after that.
+const char* const MANIFEST_FILE = "students.manifest";
+const char* const MANIFEST_MAGIC = "SMS-SHARDS";
+const size_t MAX_SHARDS = 4096;
+
+// Fibonacci hashing, so runs of consecutive roll numbers spread evenly
+size_t shardOf(int rollNo, size_t shards) {
+    uint32_t h = static_cast<uint32_t>(rollNo) * 2654435769u;
+    return static_cast<size_t>((uint64_t(h) * shards) >> 32);
+}
+
+struct ShardManifest {
+    uint64_t generation = 0;
+    uint64_t journalSeq = 0;
+    vector<string> files;
+    vector<uint64_t> counts;
+
+    size_t shardCount() const { return files.size(); }
+
+    static ShardManifest read(const string& path) {
+        ifstream in(path);
+        if (!in) throw StudentException("Cannot open shard manifest");
+        ShardManifest m;
+        string magic;
+        int version = 0;
+        size_t shards = 0;
+        if (!(in >> magic >> version >> shards >> m.generation >> m.journalSeq)
+            || magic != MANIFEST_MAGIC || version != 1 || shards == 0 || shards > MAX_SHARDS) {
+            throw StudentException("Corrupted shard manifest");
+        }
+        m.files.resize(shards);
+        m.counts.resize(shards);
+        for (size_t s = 0; s < shards; s++) {
+            if (!(in >> m.files[s] >> m.counts[s])) throw StudentException("Corrupted shard manifest");
+        }
+        return m;
+    }
+
+    void write(const string& path) const {
+        string tmp = path + ".tmp";
+        {
+            ofstream out(tmp, ios::trunc);
+            out << MANIFEST_MAGIC << " 1\n" << shardCount() << " " << generation << " " << journalSeq << "\n";
+            for (size_t s = 0; s < shardCount(); s++) out << files[s] << " " << counts[s] << "\n";
+            out.close();
+            if (out.fail()) throw StudentException("Failed to write shard manifest");
+        }
+        syncFile(tmp);
+        filesystem::rename(tmp, path);
+    }
+};
+
+// Split a store into `shards` sorted shard files, written in parallel,
+// and commit them with a new manifest
+ShardManifest writeShardedSnapshot(const StudentStore& students, size_t shards, uint64_t journalSeq,
+                                   uint64_t generation) {
+    vector<vector<uint32_t>> slots(shards);
+    for (size_t i = 0; i < students.size(); i++) {
+        if (students.isLive(i)) slots[shardOf(students.rollNoAt(i), shards)].push_back(static_cast<uint32_t>(i));
+    }
+
+    ShardManifest manifest;
+    manifest.generation = generation;
+    manifest.journalSeq = journalSeq;
+    manifest.files.resize(shards);
+    manifest.counts.resize(shards);
+    size_t workers = min<size_t>(workerCount(), shards);
+    parallelFor(workers, [&](size_t w) {
+        for (size_t s = w; s < shards; s += workers) {
+            vector<uint32_t>& mine = slots[s];
+            sort(mine.begin(), mine.end(),
+                 [&](uint32_t a, uint32_t b) { return students.rollNoAt(a) < students.rollNoAt(b); });
+            StudentStore shard;
+            shard.reserve(mine.size());
+            for (uint32_t i : mine) shard.append(students.nameAt(i), students.rollNoAt(i), students.marksAt(i));
+            manifest.files[s] = "students." + to_string(generation) + "." + to_string(s) + ".dat";
+            manifest.counts[s] = mine.size();
+            writeSnapshot(shard, journalSeq, manifest.files[s]);
+        }
+    });
+    manifest.write(MANIFEST_FILE);
+    return manifest;
+}
+
+// Save `students` in the layout for `shards` (a plain students.dat when it
+// is 1, compressed if `packed`), then delete the files of the previous
+// layout that the new one no longer uses. Returns the files making up the
+// new layout. Shards are always in the binary format, as they are mapped.
+vector<string> writeRoster(const StudentStore& students, uint64_t journalSeq, size_t shards, uint64_t generation,
+                           bool packed, const vector<string>& previousFiles) {
+    vector<string> files;
+    if (shards <= 1) {
+        if (packed) writePackedSnapshot(students, journalSeq);
+        else writeSnapshot(students, journalSeq);
+        filesystem::remove(MANIFEST_FILE);   // students.dat is authoritative from here on
+        files.push_back(DATA_FILE);
+    }
+    else {
+        files = writeShardedSnapshot(students, shards, journalSeq, generation).files;
+    }
+    for (const string& old : previousFiles) {
+        if (find(files.begin(), files.end(), old) == files.end()) filesystem::remove(old);
+    }
+    return files;
+}
+
+// Missing files count as empty; a missing shard is reported when it is mapped
+uint64_t totalFileSize(const vector<string>& files) {
+    uint64_t bytes = 0;
+    for (const string& f : files) {
+        error_code missing;
+        uintmax_t size = filesystem::file_size(f, missing);
+        if (!missing) bytes += size;
+    }
+    return bytes;
+}
+
+// Read-only view over a sharded roster. Shards are mapped on first use (safe
+// with concurrent readers), so a lookup by roll number maps one file and
+// binary-searches its roll column. Global slot i lives in the shard whose
+// range [base(s), base(s + 1)) contains it.
+class ShardedRoster {
+private:
+    ShardManifest manifest;
+    vector<size_t> bases;   // first global slot of each shard, then the total
+    unique_ptr<MappedRoster[]> shards;
+    unique_ptr<once_flag[]> opened;
+
+    size_t shardAt(size_t i) const {
+        return static_cast<size_t>(upper_bound(bases.begin(), bases.end(), i) - bases.begin()) - 1;
+    }
+
+public:
+    void open(const string& manifestPath) {
+        ShardManifest m = ShardManifest::read(manifestPath);
+        manifest = move(m);
+        bases.assign(1, 0);
+        for (uint64_t c : manifest.counts) bases.push_back(bases.back() + static_cast<size_t>(c));
+        shards.reset(new MappedRoster[manifest.shardCount()]);
+        opened.reset(new once_flag[manifest.shardCount()]);
+    }
+
+    void close() {
+        shards.reset();
+        opened.reset();
+        bases.clear();
+        manifest = ShardManifest();
+    }
+
+    bool isOpen() const { return shards != nullptr; }
+    size_t size() const { return bases.empty() ? 0 : bases.back(); }
+    size_t shardCount() const { return manifest.shardCount(); }
+    const ShardManifest& layout() const { return manifest; }
+    uint64_t lastJournalSeq() const { return manifest.journalSeq; }
+
+    // Shard s, mapped (and checked against the manifest) on first use
+    const MappedRoster& shard(size_t s) const {
+        call_once(opened[s], [&] {
+            MappedRoster& r = shards[s];
+            r.open(manifest.files[s]);
+            SMS_COUNT_BYTES(bytesRead, filesystem::file_size(manifest.files[s]));
+            if (r.size() != manifest.counts[s] || r.lastJournalSeq() != manifest.journalSeq) {
+                r.close();
+                throw StudentException("Shard " + manifest.files[s] + " does not match the manifest");
+            }
+        });
+        return shards[s];
+    }
+
+    int rollNoAt(size_t i) const {
+        size_t s = shardAt(i);
+        return shard(s).rollNoAt(i - bases[s]);
+    }
+
+    float marksAt(size_t i) const {
+        size_t s = shardAt(i);
+        return shard(s).marksAt(i - bases[s]);
+    }
+
+    string_view nameAt(size_t i) const {
+        size_t s = shardAt(i);
+        return shard(s).nameAt(i - bases[s]);
+    }
+
+    // f(shard, first, count) for each shard's part of global slots [begin, end)
+    template <typename F>
+    void forEachRun(size_t begin, size_t end, F f) const {
+        while (begin < end) {
+            size_t s = shardAt(begin);
+            size_t n = min(end, bases[s + 1]) - begin;
+            f(shard(s), begin - bases[s], n);
+            begin += n;
+        }
+    }
+
+    // Global slot of rollNo, or -1; only its own shard is touched
+    int find(int rollNo) const {
+        size_t s = shardOf(rollNo, shardCount());
+        const MappedRoster& r = shard(s);
+        size_t lo = 0, hi = r.size();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (r.rollNoAt(mid) < rollNo) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo < r.size() && r.rollNoAt(lo) == rollNo ? static_cast<int>(bases[s] + lo) : -1;
+    }
+};
+
+// One change in a batch update (StudentManagementSystem::updateRecords);
+// a field left empty keeps its current value
+struct RecordChange {
+    int rollNo;
+    optional<string> name;
+    optional<float> marks;
+};
+
+// ========== Snapshots ==========
+// An immutable, consistent copy of the roster for long-running readers
+// (listings, exports, reports). It is a list of shared chunks, each one
+// SNAPSHOT_CHUNK_ROWS consecutive slots with tombstones kept in place, so
+// the sorted views' slot numbers still apply. The system keeps the chunk
+// list current as it changes (see StudentManagementSystem::touchSnapshot),
+// so taking a snapshot only copies pointers. A chunk (and a snapshot) is
+// reclaimed by reference counting once the last reader lets go of it.
+const size_t SNAPSHOT_CHUNK_ROWS = 4096;
+static_assert(SNAPSHOT_CHUNK_ROWS == PACKED_BLOCK_ROWS, "a compressed block must be one snapshot chunk");
+
+// One chunk: either a copy of the records (the roster is in memory) or a
+// view of a read-only roster's backing. A mapped chunk points into the
+// file's pages, one run per shard it spans; a compressed chunk is that
+// block, decoded by the first reader that needs it. Views share the
+// mapping, so they stay valid after the roster is closed.
+class SnapshotChunk {
+public:
+    struct MappedRun {
+        MappedRoster roster;
+        size_t first, count;
+    };
+
+    StudentStore copy;
+    vector<MappedRun> runs;
+    shared_ptr<const PackedBlock> block;
+
+    bool isCopy() const { return runs.empty() && !block; }
+
+    // visit(name, rollNo, marks) for slot i if it is live; false stops the walk
+    template <typename F>
+    bool visit(size_t i, F& f) const {
+        if (block) {
+            const StudentStore& b = block->records();
+            return f(b.nameAt(i), b.rollNoAt(i), b.marksAt(i));
+        }
+        for (const MappedRun& r : runs) {
+            if (i < r.count) return f(r.roster.nameAt(r.first + i), r.roster.rollNoAt(r.first + i), r.roster.marksAt(r.first + i));
+            i -= r.count;
+        }
+        return !copy.isLive(i) || f(copy.nameAt(i), copy.rollNoAt(i), copy.marksAt(i));
+    }
+
+    template <typename F>
+    bool visitAll(F& f) const {
+        if (block) {
+            const StudentStore& b = block->records();
+            for (size_t i = 0; i < b.size(); i++) {
+                if (!f(b.nameAt(i), b.rollNoAt(i), b.marksAt(i))) return false;
+            }
+            return true;
+        }
+        for (const MappedRun& r : runs) {
+            for (size_t i = r.first; i < r.first + r.count; i++) {
+                if (!f(r.roster.nameAt(i), r.roster.rollNoAt(i), r.roster.marksAt(i))) return false;
+            }
+        }
+        for (size_t i = 0; i < copy.size(); i++) {
+            if (copy.isLive(i) && !f(copy.nameAt(i), copy.rollNoAt(i), copy.marksAt(i))) return false;
+        }
+        return true;
+    }
+};
+
+using SnapshotChunks = vector<shared_ptr<const SnapshotChunk>>;
+
+class RosterSnapshot {
+private:
+    shared_ptr<const SnapshotChunks> chunks;
+    shared_ptr<const vector<uint32_t>> order;   // slots in listing order; null for slot order
+    size_t records = 0;
+    uint64_t seq = 0;
+
+public:
+    RosterSnapshot() = default;
+    RosterSnapshot(shared_ptr<const SnapshotChunks> c, shared_ptr<const vector<uint32_t>> o, size_t n, uint64_t s)
+        : chunks(move(c)), order(move(o)), records(n), seq(s) {}
+
+    size_t size() const { return records; }
+    uint64_t journalSeq() const { return seq; }   // newest change the snapshot includes
+
+    // visit(name, rollNo, marks) for every record in listing order, until
+    // it returns false
+    template <typename F>
+    void forEach(F&& visit) const {
+        if (!chunks) return;
+        if (order) {
+            for (uint32_t slot : *order) {
+                if (!(*chunks)[slot / SNAPSHOT_CHUNK_ROWS]->visit(slot % SNAPSHOT_CHUNK_ROWS, visit)) return;
+            }
+            return;
+        }
+        for (const shared_ptr<const SnapshotChunk>& chunk : *chunks) {
+            if (!chunk->visitAll(visit)) return;
+        }
+    }
+};
+
+// ========== OOP: Management System Class ==========
+class StudentManagementSystem {
+private:
+    StudentStore students;
+    RollIndex rollIndex;   // rollNo -> position in students
+    bool indexBuilt = true;
+
+    // Secondary index on marks; built on the first range/top-K query and
+    // maintained incrementally from then on
+    MarksIndex marksIndex;
+    bool marksIndexBuilt = false;
+
+    void ensureMarksIndex() {
+        if (marksIndexBuilt) return;
+        vector<MarksKey> keys;
+        keys.reserve(recordCount());
+        for (size_t i = 0; i < slotCount(); i++) {
+            if (rollNoAt(i) != StudentStore::TOMBSTONE) keys.push_back(MarksKey{marksAt(i), rollNoAt(i)});
+        }
+        marksIndex.build(move(keys));
+        marksIndexBuilt = true;
+    }
+
+    // Running aggregates for showStatistics; built on first use
+    RunningStats stats;
+    bool statsBuilt = false;
+
+    void ensureStats() {
+        if (statsBuilt) return;
+        compactStore();   // the kernels want a column without holes
+        stats.clear();
+        forEachMarksColumn([this](const float* marks, size_t n) { stats.addColumn(marks, n); });
+        statsBuilt = true;
+    }
+
+    // Trigram index for name search; built on the first name query
+    NameIndex nameIndex;
+    bool nameIndexBuilt = false;
+
+    void ensureNameIndex() {
+        if (nameIndexBuilt && !nameIndex.needsRebuild()) return;
+        nameIndex.clear();
+        for (size_t i = 0; i < slotCount(); i++) {
+            if (rollNoAt(i) != StudentStore::TOMBSTONE) nameIndex.add(rollNoAt(i), nameAt(i));
+        }
+        nameIndexBuilt = true;
+    }
+
+    // Sorted listings (SortKey::Name, RollNo, Marks): a permutation of live
+    // slots, so the records never move. Each is built by a parallel sort on
+    // first use and dropped only by changes to its key: a rename drops the
+    // name view, new marks the marks view, and an add or a compaction
+    // (slots move) drops all three. A delete just leaves a tombstoned slot
+    // that the listing skips. Views are shared_ptrs so a paging listing
+    // can keep its view while the lock is released.
+    shared_ptr<const vector<uint32_t>> orderedViews[3];
+
+    shared_ptr<const vector<uint32_t>>& orderedView(SortKey key) {
+        return orderedViews[static_cast<int>(key) - 1];
+    }
+
+    void dropOrderedView(SortKey key) { orderedView(key).reset(); }
+
+    void dropOrderedViews() {
+        for (auto& view : orderedViews) view.reset();
+    }
+
+    // Sort (key, slot) entries and keep just the slots
+    template <typename Entry, typename Less>
+    static shared_ptr<const vector<uint32_t>> sortedSlots(vector<Entry>& entries, Less less) {
+        parallelSort(entries, less);
+        auto order = make_shared<vector<uint32_t>>(entries.size());
+        for (size_t k = 0; k < entries.size(); k++) (*order)[k] = entries[k].slot;
+        return order;
+    }
+
+    // Caller holds rosterLock exclusively
+    const shared_ptr<const vector<uint32_t>>& ensureOrderedView(SortKey key) {
+        shared_ptr<const vector<uint32_t>>& view = orderedView(key);
+        if (view) return view;
+        switch (key) {
+            case SortKey::Name: {
+                struct Entry { string_view name; int32_t rollNo; uint32_t slot; };
+                vector<Entry> entries;
+                entries.reserve(recordCount());
+                for (size_t i = 0; i < slotCount(); i++) {
+                    if (rollNoAt(i) != StudentStore::TOMBSTONE) entries.push_back(Entry{nameAt(i), rollNoAt(i), uint32_t(i)});
+                }
+                auto fold = [](char c) { return tolower(static_cast<unsigned char>(c)); };
+                view = sortedSlots(entries, [&](const Entry& a, const Entry& b) {
+                    auto diff = mismatch(a.name.begin(), a.name.end(), b.name.begin(), b.name.end(),
+                                         [&](char x, char y) { return fold(x) == fold(y); });
+                    if (diff.first != a.name.end() && diff.second != b.name.end()) {
+                        return fold(*diff.first) < fold(*diff.second);
+                    }
+                    if (a.name.size() != b.name.size()) return a.name.size() < b.name.size();
+                    return a.rollNo < b.rollNo;
+                });
+                break;
+            }
+            case SortKey::RollNo: {
+                struct Entry { int32_t rollNo; uint32_t slot; };
+                vector<Entry> entries;
+                entries.reserve(recordCount());
+                for (size_t i = 0; i < slotCount(); i++) {
+                    if (rollNoAt(i) != StudentStore::TOMBSTONE) entries.push_back(Entry{rollNoAt(i), uint32_t(i)});
+                }
+                view = sortedSlots(entries, [](const Entry& a, const Entry& b) { return a.rollNo < b.rollNo; });
+                break;
+            }
+            default: {
+                struct Entry { float marks; int32_t rollNo; uint32_t slot; };
+                vector<Entry> entries;
+                entries.reserve(recordCount());
+                for (size_t i = 0; i < slotCount(); i++) {
+                    if (rollNoAt(i) != StudentStore::TOMBSTONE) {
+                        entries.push_back(Entry{marksAt(i), rollNoAt(i), uint32_t(i)});
+                    }
+                }
+                view = sortedSlots(entries, [](const Entry& a, const Entry& b) {
+                    return a.marks != b.marks ? a.marks > b.marks : a.rollNo < b.rollNo;
+                });
+                break;
+            }
+        }
+        return view;
+    }
+
+    // Snapshot state (see RosterSnapshot). Entry c of snapshotChunks is
+    // chunk c as it stands. While `students` holds the roster every entry
+    // is a copy, kept current by the writers under the exclusive rosterLock:
+    // a chunk no published list shares is changed in place, a shared one is
+    // copied again (at most SNAPSHOT_CHUNK_ROWS records) on its first change.
+    // While a read-only view is open the entries are views, made by the
+    // first snapshot. `publishedChunks` is the list as last handed out,
+    // null after any change; it is refilled under the shared lock plus
+    // snapshotLock, and publishing it is only a copy of pointers.
+    vector<shared_ptr<SnapshotChunk>> snapshotChunks;
+    shared_ptr<const SnapshotChunks> publishedChunks;
+    mutex snapshotLock;
+
+    size_t chunkCount() const { return (slotCount() + SNAPSHOT_CHUNK_ROWS - 1) / SNAPSHOT_CHUNK_ROWS; }
+
+    // Whether a writer may change chunk c in place. Readers take new
+    // references only from publishedChunks under the shared lock, which
+    // the writer's exclusive lock rules out, so the count cannot grow.
+    // use_count() alone is a relaxed load and would not order the change
+    // after a reader that just dropped the last other reference; taking a
+    // reference is an acq_rel increment of the same count, which does.
+    bool ownsChunk(size_t c) const {
+        if (c >= snapshotChunks.size()) return false;
+        shared_ptr<const SnapshotChunk> probe = snapshotChunks[c];
+        return probe.use_count() == 2 && probe->isCopy();
+    }
+
+    static void copySlot(StudentStore& chunk, const StudentStore& from, size_t i) {
+        if (from.isLive(i)) {
+            chunk.append(from.nameAt(i), from.rollNoAt(i), from.marksAt(i));
+        }
+        else {
+            chunk.append(string_view(), 0, 0);
+            chunk.erase(chunk.size() - 1);
+        }
+    }
+
+    // Chunk c of `from`, copied (copies are only ever made of `students`,
+    // or of a roster about to replace it)
+    static shared_ptr<SnapshotChunk> copyChunk(const StudentStore& from, size_t c) {
+        auto chunk = make_shared<SnapshotChunk>();
+        size_t end = min(from.size(), (c + 1) * SNAPSHOT_CHUNK_ROWS);
+        chunk->copy.reserve(end - c * SNAPSHOT_CHUNK_ROWS);
+        for (size_t i = c * SNAPSHOT_CHUNK_ROWS; i < end; i++) copySlot(chunk->copy, from, i);
+        return chunk;
+    }
+
+    // Every chunk of `from`, copied in parallel into chunks[first..]
+    static void copyChunks(const StudentStore& from, vector<shared_ptr<SnapshotChunk>>& chunks, size_t first) {
+        chunks.resize((from.size() + SNAPSHOT_CHUNK_ROWS - 1) / SNAPSHOT_CHUNK_ROWS);
+        if (first >= chunks.size()) return;
+        size_t workers = min<size_t>(workerCount(), chunks.size() - first);
+        parallelFor(workers, [&](size_t w) {
+            for (size_t c = first + w; c < chunks.size(); c += workers) chunks[c] = copyChunk(from, c);
+        });
+    }
+
+    // Chunk c of the open read-only view, pointing at its pages
+    shared_ptr<SnapshotChunk> viewChunk(size_t c) const {
+        size_t first = c * SNAPSHOT_CHUNK_ROWS, end = min(slotCount(), first + SNAPSHOT_CHUNK_ROWS);
+        auto chunk = make_shared<SnapshotChunk>();
+        if (compressed.isOpen()) {
+            chunk->block = compressed.sharedBlock(c);
+        }
+        else if (mapped.isOpen()) {
+            chunk->runs.push_back(SnapshotChunk::MappedRun{mapped, first, end - first});
+        }
+        else if (sharded.isOpen()) {
+            sharded.forEachRun(first, end, [&](const MappedRoster& shard, size_t from, size_t n) {
+                chunk->runs.push_back(SnapshotChunk::MappedRun{shard, from, n});
+            });
+        }
+        else {
+            return copyChunk(students, c);
+        }
+        return chunk;
+    }
+
+    // Slot i changed; caller holds the exclusive lock with `students` live
+    void touchSnapshot(size_t i) {
+        publishedChunks.reset();
+        size_t c = i / SNAPSHOT_CHUNK_ROWS, k = i % SNAPSHOT_CHUNK_ROWS;
+        if (!ownsChunk(c) || k >= snapshotChunks[c]->copy.size()) {
+            snapshotChunks.resize(max(snapshotChunks.size(), chunkCount()));
+            snapshotChunks[c] = copyChunk(students, c);
+            return;
+        }
+        StudentStore& chunk = snapshotChunks[c]->copy;
+        if (!students.isLive(i)) {
+            if (chunk.isLive(k)) chunk.erase(k);
+        }
+        else {
+            chunk.update(k, students.nameAt(i), students.marksAt(i));
+        }
+    }
+
+    // Slots from `first` on were appended, moved or dropped: extend the
+    // chunk holding `first` in place if nothing shares it, copy the rest
+    void refreshSnapshotChunks(size_t first = 0) {
+        publishedChunks.reset();
+        size_t c = first / SNAPSHOT_CHUNK_ROWS;
+        if (first % SNAPSHOT_CHUNK_ROWS != 0 && ownsChunk(c) && snapshotChunks[c]->copy.size() == first % SNAPSHOT_CHUNK_ROWS) {
+            size_t end = min(students.size(), (c + 1) * SNAPSHOT_CHUNK_ROWS);
+            for (size_t i = first; i < end; i++) copySlot(snapshotChunks[c]->copy, students, i);
+            c++;
+        }
+        copyChunks(students, snapshotChunks, c);
+    }
+
+    // Caller holds rosterLock, shared or exclusive
+    shared_ptr<const SnapshotChunks> publishChunks() {
+        lock_guard<mutex> guard(snapshotLock);
+        if (publishedChunks) return publishedChunks;
+        snapshotChunks.resize(chunkCount());
+        for (size_t c = 0; c < snapshotChunks.size(); c++) {
+            if (!snapshotChunks[c]) snapshotChunks[c] = viewChunk(c);
+        }
+        publishedChunks = make_shared<const SnapshotChunks>(snapshotChunks.begin(), snapshotChunks.end());
+        return publishedChunks;
+    }
+
+    // Name matches, verified against the stored names; caller holds rosterLock
+    vector<int> matchNames(string_view query, bool prefix) {
+        ensureNameIndex();
+        vector<int> found;
+        const vector<int32_t>* candidates = nameIndex.candidates(query, prefix);
+        if (candidates) {
+            for (int32_t rollNo : *candidates) {
+                int index = findStudentIndex(rollNo);
+                if (index != -1 && NameIndex::matches(nameAt(index), query, prefix)) found.push_back(rollNo);
+            }
+            // Stale postings can repeat a roll number after renames
+            sort(found.begin(), found.end());
+            found.erase(unique(found.begin(), found.end()), found.end());
+        }
+        else {
+            // Query too short for a trigram: scan the name column
+            for (size_t i = 0; i < slotCount(); i++) {
+                if (rollNoAt(i) != StudentStore::TOMBSTONE && NameIndex::matches(nameAt(i), query, prefix)) {
+                    found.push_back(rollNoAt(i));
+                }
+            }
+            sort(found.begin(), found.end());
+        }
+        return found;
+    }
+
+    // Drop every derived structure after the record set is replaced wholesale
+    void invalidateSecondaryIndexes() {
+        nameIndex.clear();
+        nameIndexBuilt = false;
+        marksIndex.clear();
+        marksIndexBuilt = false;
+        stats.clear();
+        statsBuilt = false;
+        dropOrderedViews();
+    }
+
+    // Read-only view of a binary students.dat. While it is open, reads are
+    // served straight from the mapped pages and `students` stays empty; the
+    // first mutation copies the records in (see materialize()).
+    MappedRoster mapped;
+
+    // The same for a sharded roster (students.manifest), whose shards are
+    // mapped on first use, and for a compressed students.dat, whose blocks
+    // are decoded on first use. At most one of the views is open.
+    ShardedRoster sharded;
+    PackedRoster compressed;
+    size_t shardCount = 1;         // layout the next save writes
+    bool packedFormat = false;     // ... and whether students.dat is compressed
+    uint64_t shardGeneration = 0;  // names the files of the current layout
+    vector<string> layoutFiles;    // data files of the layout on disk
+
+    // Record accessors that work for both mapped views and `students`.
+    // Slots may be tombstoned (rollNoAt() == TOMBSTONE) until compaction.
+    size_t slotCount() const {
+        if (sharded.isOpen()) return sharded.size();
+        if (compressed.isOpen()) return compressed.size();
+        return mapped.isOpen() ? mapped.size() : students.size();
+    }
+    size_t recordCount() const {
+        if (sharded.isOpen()) return sharded.size();
+        if (compressed.isOpen()) return compressed.size();
+        return mapped.isOpen() ? mapped.size() : students.liveCount();
+    }
+    int rollNoAt(size_t i) const {
+        if (sharded.isOpen()) return sharded.rollNoAt(i);
+        if (compressed.isOpen()) return compressed.rollNoAt(i);
+        return mapped.isOpen() ? mapped.rollNoAt(i) : students.rollNoAt(i);
+    }
+    float marksAt(size_t i) const {
+        if (sharded.isOpen()) return sharded.marksAt(i);
+        if (compressed.isOpen()) return compressed.marksAt(i);
+        return mapped.isOpen() ? mapped.marksAt(i) : students.marksAt(i);
+    }
+    string_view nameAt(size_t i) const {
+        if (sharded.isOpen()) return sharded.nameAt(i);
+        if (compressed.isOpen()) return compressed.nameAt(i);
+        return mapped.isOpen() ? mapped.nameAt(i) : students.nameAt(i);
+    }
+
+    // Call f(marks, n) over the marks column in contiguous pieces, one per
+    // shard; callers compact `students` first so the column has no holes
+    template <typename F>
+    void forEachMarksColumn(F f) const {
+        if (sharded.isOpen()) {
+            for (size_t s = 0; s < sharded.shardCount(); s++) {
+                const MappedRoster& shard = sharded.shard(s);
+                f(shard.marksColumn(), shard.size());
+            }
+        }
+        else if (compressed.isOpen()) {
+            for (size_t b = 0; b < compressed.blockCount(); b++) {
+                const StudentStore& block = compressed.block(b);
+                f(block.marksColumn(), block.size());
+            }
+        }
+        else {
+            f(mapped.isOpen() ? mapped.marksColumn() : students.marksColumn(), recordCount());
+        }
+    }
+
+    void displayRecord(size_t i, ostream& out = cout) const {
+        if (sharded.isOpen() || compressed.isOpen() || mapped.isOpen()) displayRow(nameAt(i), rollNoAt(i), marksAt(i), out);
+        else students.display(i, out);
+    }
+
+    // Rebuild the roll number index from scratch (after a bulk load)
+    void rebuildIndex() {
+        rollIndex.clear();
+        rollIndex.reserve(recordCount());
+        for (int i = 0; i < static_cast<int>(slotCount()); i++) {
+            if (rollNoAt(i) == StudentStore::TOMBSTONE) continue;
+            // Keep the first occurrence, as the old linear search did
+            if (rollIndex.find(rollNoAt(i)) == -1) {
+                rollIndex.insert(rollNoAt(i), i);
+            }
+        }
+        indexBuilt = true;
+    }
+
+    // Append parsed chunks in file order, rejecting duplicate roll numbers
+    // the same way addStudent does. Returns how many records were rejected.
+    size_t mergeChunks(const vector<StudentStore>& chunks) {
+        size_t total = 0, rejected = 0, first = students.size();
+        for (const StudentStore& chunk : chunks) total += chunk.size();
+        students.reserve(students.size() + total);
+        rollIndex.reserve(students.size() + total);
+        for (const StudentStore& chunk : chunks) {
+            for (size_t i = 0; i < chunk.size(); i++) {
+                if (rollIndex.find(chunk.rollNoAt(i)) != -1) {
+                    rejected++;
+                    continue;
+                }
+                students.append(chunk.nameAt(i), chunk.rollNoAt(i), chunk.marksAt(i));
+                rollIndex.insert(chunk.rollNoAt(i), static_cast<int>(students.size()) - 1);
+            }
+        }
+        indexBuilt = true;
+        refreshSnapshotChunks(first);
+        invalidateSecondaryIndexes();
+        return rejected;
+    }
+
+    // Squeeze tombstones out of the store; slots move, so re-index
+    void compactStore() {
+        if (students.deadCount() == 0) return;
+        students.compact();
+        rebuildIndex();
+        refreshSnapshotChunks();
+        dropOrderedViews();
+    }
+
+    // Copy-on-first-write: turn the mapped view into owned records.
+    // Slots keep their positions, so the roll number index stays valid.
+    // Any snapshot chunks were views of the closed file; they become copies
+    // like an in-memory roster's, so the file's pages are not kept alive.
+    void materialize() {
+        if (sharded.isOpen()) materializeShards();
+        else if (compressed.isOpen()) materializePacked();
+        else if (mapped.isOpen()) materializeMapped();
+        else return;
+        refreshSnapshotChunks();
+    }
+
+    void materializeMapped() {
+        StudentStore loaded;
+        loaded.reserve(mapped.size());
+        for (size_t i = 0; i < mapped.size(); i++) {
+            if (!Student::validRollNo(mapped.rollNoAt(i)) || !Student::validMarks(mapped.marksAt(i))) {
+                throw StudentException("Corrupted data in file");
+            }
+            loaded.append(mapped.nameAt(i), mapped.rollNoAt(i), mapped.marksAt(i));
+        }
+        students = move(loaded);
+        mapped.close();
+    }
+
+    // Sharded roster: map and check the shards in parallel, then copy them
+    // in slot order. Lookups went through the shards until now, so the roll
+    // number index is built on the next lookup.
+    void materializeShards() {
+        size_t shards = sharded.shardCount();
+        size_t workers = min<size_t>(workerCount(), shards);
+        parallelFor(workers, [&](size_t w) {
+            for (size_t s = w; s < shards; s += workers) {
+                const MappedRoster& shard = sharded.shard(s);
+                for (size_t i = 0; i < shard.size(); i++) {
+                    if (!Student::validRollNo(shard.rollNoAt(i)) || !Student::validMarks(shard.marksAt(i))) {
+                        throw StudentException("Corrupted data in file");
+                    }
+                }
+            }
+        });
+        StudentStore loaded;
+        loaded.reserve(sharded.size());
+        for (size_t s = 0; s < shards; s++) {
+            const MappedRoster& shard = sharded.shard(s);
+            for (size_t i = 0; i < shard.size(); i++) loaded.append(shard.nameAt(i), shard.rollNoAt(i), shard.marksAt(i));
+        }
+        students = move(loaded);
+        sharded.close();
+        indexBuilt = false;
+    }
+
+    // Compressed roster: decode the blocks no query has needed yet, in
+    // parallel, then copy them all in slot order
+    void materializePacked() {
+        size_t blocks = compressed.blockCount();
+        size_t workers = min<size_t>(workerCount(), blocks);
+        parallelFor(workers, [&](size_t w) {
+            for (size_t b = w; b < blocks; b += workers) compressed.block(b);
+        });
+        StudentStore loaded;
+        loaded.reserve(compressed.size());
+        for (size_t b = 0; b < blocks; b++) {
+            const StudentStore& block = compressed.block(b);
+            for (size_t i = 0; i < block.size(); i++) loaded.append(block.nameAt(i), block.rollNoAt(i), block.marksAt(i));
+        }
+        students = move(loaded);
+        compressed.close();
+        indexBuilt = false;
+    }
+
+    // Journal state: every mutation is logged before the call returns and
+    // folded into students.dat by the background flusher.
+    Journal journal;
+    uint64_t lastSeq = 0;        // sequence number of the newest change
+    uint64_t savedSeq = 0;       // newest change already in students.dat
+    uint64_t snapshotBytes = 0;  // size of students.dat as last written/loaded
+    bool needsFullSave = false;  // legacy/corrupt file or a new layout must be written
+
+    // Replication: the backlog followers are streamed from, and whether this
+    // node is a follower, which takes changes only from its primary
+    ReplicationLog replicationLog;
+    bool replica = false;
+
+    // Background persistence. The flusher thread writes a fresh snapshot
+    // every SAVE_INTERVAL while there are unsaved changes, and as soon as
+    // it is asked to (journal over JOURNAL_COMPACT_BYTES, legacy file).
+    static constexpr chrono::seconds SAVE_INTERVAL{60};
+    thread flusher;
+    mutex flushLock;              // guards the three fields below
+    condition_variable flushWake;
+    bool flushRequested = false;
+    bool shuttingDown = false;
+    string flushError;            // last failure, reported at exit
+    mutex saveLock;               // one whole-roster write at a time
+
+    // ---- Core mutations (input already validated, journal not touched) ----
+    void insertRecord(string_view name, int rollNo, float marks) {
+        Student::checkRollNo(rollNo);
+        Student::checkMarks(marks);
+        materialize();
+        students.emplace_back(name, rollNo, marks);
+        refreshSnapshotChunks(students.size() - 1);
+        rollIndex.insert(rollNo, static_cast<int>(students.size()) - 1);
+        if (marksIndexBuilt) marksIndex.insert(MarksKey{marks, rollNo});
+        if (statsBuilt) stats.add(marks);
+        if (nameIndexBuilt) nameIndex.add(rollNo, name);
+        dropOrderedViews();
+    }
+
+    void updateRecord(int index, string_view name, float marks) {
+        Student::checkName(name);
+        Student::checkMarks(marks);
+        materialize();
+        float oldMarks = students.marksAt(index);
+        if (name != students.nameAt(index)) {
+            if (nameIndexBuilt) {
+                nameIndex.remove(students.nameAt(index));
+                nameIndex.add(students.rollNoAt(index), name);
+            }
+            dropOrderedView(SortKey::Name);
+        }
+        students.update(index, name, marks);
+        touchSnapshot(index);
+        if (oldMarks != marks) {
+            if (marksIndexBuilt) {
+                marksIndex.erase(MarksKey{oldMarks, students.rollNoAt(index)});
+                marksIndex.insert(MarksKey{marks, students.rollNoAt(index)});
+            }
+            dropOrderedView(SortKey::Marks);
+        }
+        if (statsBuilt) stats.replace(oldMarks, marks);
+    }
+
+    void removeRecord(int index) {
+        materialize();
+        int rollNo = students.rollNoAt(index);
+        if (marksIndexBuilt) marksIndex.erase(MarksKey{students.marksAt(index), rollNo});
+        if (statsBuilt) stats.remove(students.marksAt(index));
+        if (nameIndexBuilt) nameIndex.remove(students.nameAt(index));
+        rollIndex.erase(rollNo);
+        students.erase(index);
+        touchSnapshot(index);
+        // Compact lazily, once tombstones make up half the slots; each
+        // compaction is O(n) but pays for at least n/2 deletes
+        if (students.deadCount() >= 64 && students.deadCount() * 2 > students.size()) {
+            compactStore();
+        }
+    }
+
+    // Check a batch of changes and resolve each to its slot and final name
+    // and marks. Throws on the first change that cannot apply, having
+    // changed nothing.
+    void resolveUpdates(const vector<RecordChange>& changes, vector<int>& slots, vector<string>& names,
+                        vector<float>& marks) {
+        RollIndex seen;
+        seen.reserve(changes.size());
+        slots.reserve(changes.size());
+        names.reserve(changes.size());
+        marks.reserve(changes.size());
+        for (size_t i = 0; i < changes.size(); i++) {
+            const RecordChange& c = changes[i];
+            try {
+                Student::checkRollNo(c.rollNo);
+                if (seen.find(c.rollNo) != -1) throw StudentException("Roll No appears more than once in the batch");
+                seen.insert(c.rollNo, static_cast<int>(i));
+                int slot = findStudentIndex(c.rollNo);
+                if (slot == -1) throw StudentException("Student not found");
+                if (c.name) Student::checkName(*c.name);
+                if (c.marks) Student::checkMarks(*c.marks);
+                slots.push_back(slot);
+                names.emplace_back(c.name ? string_view(*c.name) : nameAt(slot));
+                marks.push_back(c.marks ? *c.marks : marksAt(slot));
+            }
+            catch (const StudentException& e) {
+                throw StudentException("Change " + to_string(i + 1) + " (Roll No " + to_string(c.rollNo) + "): " + e.what());
+            }
+        }
+    }
+
+    // Apply resolved updates as a unit. The records change first, keeping
+    // the old values so a failure part way (out of memory) restores them
+    // all; then the marks index, running stats and name index each catch
+    // up in one pass. Those are caches, so if that fails they are dropped.
+    void applyUpdates(const vector<int>& slots, const vector<string>& names, const vector<float>& marks) {
+        materialize();
+        vector<string> oldNames;
+        vector<float> oldMarks;
+        oldNames.reserve(slots.size());
+        oldMarks.reserve(slots.size());
+        for (int slot : slots) {
+            oldNames.emplace_back(students.nameAt(slot));
+            oldMarks.push_back(students.marksAt(slot));
+        }
+        size_t done = 0;
+        try {
+            for (; done < slots.size(); done++) students.update(slots[done], names[done], marks[done]);
+        }
+        catch (...) {
+            while (done-- > 0) students.update(slots[done], oldNames[done], oldMarks[done]);
+            throw;
+        }
+        for (int slot : slots) touchSnapshot(slot);
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (oldNames[i] != names[i]) dropOrderedView(SortKey::Name);
+            if (oldMarks[i] != marks[i]) dropOrderedView(SortKey::Marks);
+        }
+
+        try {
+            if (marksIndexBuilt) {
+                vector<MarksKey> erased, inserted;
+                for (size_t i = 0; i < slots.size(); i++) {
+                    if (oldMarks[i] == marks[i]) continue;
+                    erased.push_back(MarksKey{oldMarks[i], students.rollNoAt(slots[i])});
+                    inserted.push_back(MarksKey{marks[i], students.rollNoAt(slots[i])});
+                }
+                marksIndex.replace(move(erased), move(inserted));
+            }
+            if (statsBuilt) stats.replaceAll(oldMarks, marks);
+            if (nameIndexBuilt) {
+                for (size_t i = 0; i < slots.size(); i++) {
+                    if (oldNames[i] == names[i]) continue;
+                    nameIndex.remove(oldNames[i]);
+                    nameIndex.add(students.rollNoAt(slots[i]), names[i]);
+                }
+            }
+        }
+        catch (...) {
+            invalidateSecondaryIndexes();   // rebuilt from the records on next use
+        }
+    }
+
+    void applyUpdateBatch(const vector<RecordChange>& changes) {
+        vector<int> slots;
+        vector<string> names;
+        vector<float> marks;
+        resolveUpdates(changes, slots, names, marks);
+        applyUpdates(slots, names, marks);
+    }
+
+    // Apply one journal entry during replay; throws if it no longer applies
+    void applyEntry(const JournalEntry& e) {
+        int index = findStudentIndex(e.rollNo);
+        switch (e.op) {
+            case JournalOp::Add:
+                if (index != -1) throw StudentException("Student with this Roll No already exists");
+                insertRecord(e.name, e.rollNo, e.marks);
+                break;
+            case JournalOp::Update:
+                if (index == -1) throw StudentException("Student not found");
+                updateRecord(index, e.name, e.marks);
+                break;
+            case JournalOp::Delete:
+                if (index == -1) throw StudentException("Student not found");
+                removeRecord(index);
+                break;
+            default:
+                throw StudentException("Unknown journal operation");
+        }
+    }
+
+    // Replay entries newer than the data file; returns how many were applied
+    size_t replayJournal(const string& path) {
+        size_t applied = 0, skipped = 0;
+        if (filesystem::exists(path)) SMS_COUNT_BYTES(bytesRead, filesystem::file_size(path));
+        vector<JournalEntry> entries = Journal::readAll(path);
+        for (size_t i = 0; i < entries.size(); i++) {
+            const JournalEntry& e = entries[i];
+            if (e.seq <= lastSeq) continue;   // already folded into students.dat
+            if (e.op == JournalOp::Begin) {
+                // readAll only returns complete transactions
+                size_t n = min(static_cast<size_t>(max(e.rollNo, 0)), entries.size() - i - 1);
+                vector<RecordChange> changes;
+                changes.reserve(n);
+                for (size_t k = 1; k <= n; k++) {
+                    changes.push_back(RecordChange{entries[i + k].rollNo, entries[i + k].name, entries[i + k].marks});
+                }
+                try {
+                    applyUpdateBatch(changes);
+                    applied += n;
+                }
+                catch (const StudentException&) {
+                    skipped += n;
+                }
+                i += n;
+                lastSeq = entries[i].seq;
+                continue;
+            }
+            try {
+                applyEntry(e);
+                applied++;
+            }
+            catch (const StudentException&) {
+                skipped++;
+            }
+            lastSeq = e.seq;
+        }
+        if (skipped > 0) cout << "Warning: " << skipped << " journal entries could not be applied." << endl;
+        return applied;
+    }
+
+    // Journal one entry and keep it for followers
+    void journalEntry(uint64_t seq, JournalOp op, int rollNo, float marks, string_view name) {
+        journal.append(seq, op, rollNo, marks, name);
+        replicationLog.append(seq, op, rollNo, marks, name);
+    }
+
+    // Log a mutation that has just been applied
+    void logChange(JournalOp op, int rollNo, string_view name = string_view(), float marks = 0.0f) {
+        journalEntry(++lastSeq, op, rollNo, marks, name);
+        replicationLog.commit(lastSeq);
+        maybeCompact();
+    }
+
+    // Changes come only from the primary while this node is a follower
+    void checkWritable() const {
+        if (replica) throw StudentException("This node is a read-only replica");
+    }
+
+    void requestFlush() {
+        {
+            lock_guard<mutex> guard(flushLock);
+            flushRequested = true;
+        }
+        flushWake.notify_one();
+    }
+
+    // Ask for a snapshot once the journal passes the threshold, or the size
+    // of the data file if that is larger: rewriting a big roster after every
+    // 4 MB of changes would make bulk loads quadratic
+    void maybeCompact() {
+        if (journal.size() >= max<uint64_t>(JOURNAL_COMPACT_BYTES, snapshotBytes)) requestFlush();
+    }
+
+    void flusherLoop() {
+        unique_lock<mutex> guard(flushLock);
+        while (!shuttingDown) {
+            flushWake.wait_for(guard, SAVE_INTERVAL, [this] { return flushRequested || shuttingDown; });
+            if (shuttingDown) break;
+            flushRequested = false;
+            guard.unlock();
+            string error;
+            try {
+                flushSnapshot();
+            }
+            catch (const exception& e) {
+                error = e.what();
+            }
+            guard.lock();
+            if (!error.empty()) flushError = error;
+        }
+    }
+
+    // Take a snapshot and rotate the journal in one exclusive section, so
+    // the snapshot matches the rotated journal exactly. That section only
+    // copies the chunk pointers (see publishChunks()); the records are
+    // gathered from the chunks and written out with no lock held, and a
+    // read-only view stays open. The rotated journal is deleted only after the
+    // snapshot has been renamed into place. If an earlier flush failed, its
+    // rotated journal is kept and the current one is left to grow: replay
+    // skips entries the snapshot already covers.
+    void flushSnapshot() {
+        SMS_TIMED(Flush);
+        lock_guard<mutex> saving(saveLock);
+        RosterSnapshot view;
+        uint64_t seq, generation;
+        size_t shards;
+        bool packed;
+        vector<string> previousFiles;
+        {
+            unique_lock<shared_mutex> lock(rosterLock);
+            if (lastSeq == savedSeq && !needsFullSave) return;
+            view = RosterSnapshot(publishChunks(), nullptr, recordCount(), lastSeq);
+            seq = lastSeq;
+            shards = shardCount;
+            packed = packedFormat;
+            generation = shardGeneration + 1;
+            previousFiles = layoutFiles;
+            if (!filesystem::exists(OLD_JOURNAL_FILE)) {
+                journal.close();
+                filesystem::rename(JOURNAL_FILE, OLD_JOURNAL_FILE);
+                journal.open(JOURNAL_FILE);
+            }
+        }
+
+        StudentStore snapshot;
+        snapshot.reserve(view.size());
+        view.forEach([&](string_view name, int rollNo, float marks) {
+            snapshot.append(name, rollNo, marks);
+            return true;
+        });
+        view = RosterSnapshot();   // let writers change the chunks in place again
+        vector<string> files = writeRoster(snapshot, seq, shards, generation, packed, previousFiles);
+        filesystem::remove(OLD_JOURNAL_FILE);
+        uint64_t bytes = totalFileSize(files);
+
+        unique_lock<shared_mutex> lock(rosterLock);
+        savedSeq = seq;
+        snapshotBytes = bytes;
+        shardGeneration = generation;
+        layoutFiles = move(files);
+        needsFullSave = shardCount != shards || packedFormat != packed;   // changed while we were writing
+    }
+
+    // File Handling: Load data from file with exception handling
+    // Binary files are memory-mapped and read in place; legacy text files are
+    // parsed record by record and rewritten in binary form on exit. A
+    // manifest takes precedence over students.dat: only the manifest is read
+    // here, and each shard is mapped when a query first needs it. Journal
+    // entries newer than the file are replayed on top.
+    void loadFromFile() {
+        SMS_TIMED(Load);
+        bool loaded = true;
+        bool haveManifest = filesystem::exists(MANIFEST_FILE);
+        ifstream file(DATA_FILE, ios::binary);
+        if (!file && !haveManifest) {
+            cout << "No existing data file found. Starting fresh." << endl;
+        }
+        else {
+            try {
+                if (haveManifest) {
+                    file.close();
+                    sharded.open(MANIFEST_FILE);
+                    lastSeq = savedSeq = sharded.lastJournalSeq();
+                    shardCount = sharded.shardCount();
+                    shardGeneration = sharded.layout().generation;
+                    layoutFiles = sharded.layout().files;
+                    snapshotBytes = totalFileSize(layoutFiles);
+                    // Left behind by a crash while resharding from one file
+                    if (filesystem::exists(DATA_FILE)) layoutFiles.push_back(DATA_FILE);
+                    indexBuilt = false;   // lookups search the shards
+                }
+                else if (isBinaryFormat(file)) {
+                    file.close();
+                    mapped.open(DATA_FILE);
+                    lastSeq = savedSeq = mapped.lastJournalSeq();
+                    snapshotBytes = filesystem::file_size(DATA_FILE);
+                    SMS_COUNT_BYTES(bytesRead, snapshotBytes);
+                    layoutFiles = {DATA_FILE};
+                    indexBuilt = false;   // built on the first lookup
+                }
+                else if (hasMagic(file, PACKED_MAGIC)) {
+                    // Only the roll numbers are decoded here; a block's names
+                    // and marks wait for the first query that reads them
+                    file.close();
+                    compressed.open(DATA_FILE);
+                    compressed.loadRollNumbers();
+                    lastSeq = savedSeq = compressed.lastJournalSeq();
+                    snapshotBytes = filesystem::file_size(DATA_FILE);
+                    SMS_COUNT_BYTES(bytesRead, snapshotBytes);
+                    packedFormat = true;
+                    layoutFiles = {DATA_FILE};
+                    indexBuilt = false;   // lookups binary-search the roll numbers
+                }
+                else {
+                    file.close();
+                    MappedFile text;
+                    if (!text.open(DATA_FILE)) throw StudentException("Error reading from file");
+                    SMS_COUNT_BYTES(bytesRead, text.size());
+                    vector<StudentStore> chunks = parseTextRoster(text.data(), text.size());
+                    size_t rejected = mergeChunks(chunks);
+                    if (rejected > 0) {
+                        cout << "Warning: " << rejected << " records with duplicate roll numbers were skipped." << endl;
+                    }
+                    cout << "Legacy text data file detected; it will be migrated to binary format on save." << endl;
+                    layoutFiles = {DATA_FILE};
+                    needsFullSave = true;
+                }
+                cout << "Data loaded successfully. " << recordCount() << " records found." << endl;
+            }
+            catch (const StudentException& e) {
+                cout << "Warning: " << e.what() << ". Starting with empty database." << endl;
+                mapped.close();
+                sharded.close();
+                compressed.close();
+                students.clear();
+                refreshSnapshotChunks();
+                rollIndex.clear();
+                indexBuilt = true;
+                invalidateSecondaryIndexes();
+                loaded = false;
+                needsFullSave = true;
+            }
+            file.close();
+        }
+
+        bool interrupted = filesystem::exists(OLD_JOURNAL_FILE);
+        if (loaded) {
+            size_t replayed = replayJournal(OLD_JOURNAL_FILE) + replayJournal(JOURNAL_FILE);
+            if (replayed > 0) cout << "Recovered " << replayed << " changes from the journal." << endl;
+        }
+        else {
+            // The journal describes changes to a file we could not read
+            filesystem::remove(OLD_JOURNAL_FILE);
+            filesystem::remove(JOURNAL_FILE);
+        }
+        journal.open(JOURNAL_FILE);
+        if (interrupted && loaded) needsFullSave = true;   // finish the interrupted flush
+    }
+
+    // File Handling: Save data to file with exception handling
+    // Writes a full snapshot in the foreground and empties the journal it
+    // supersedes; only used at exit when the flusher never got to it.
+    void saveToFile() {
+        SMS_TIMED(Save);
+        try {
+            rewriteRoster();
+            cout << "Data saved successfully. " << recordCount() << " records stored." << endl;
+        }
+        catch (const exception& e) {
+            throw StudentException(string("Save failed: ") + e.what());
+        }
+    }
+
+    // Write the whole roster in the current layout and empty the journal
+    void rewriteRoster() {
+        materialize();
+        layoutFiles = writeRoster(students, lastSeq, shardCount, shardGeneration + 1, packedFormat, layoutFiles);
+        shardGeneration++;
+        filesystem::remove(OLD_JOURNAL_FILE);
+        journal.reset();
+        savedSeq = lastSeq;
+        snapshotBytes = totalFileSize(layoutFiles);
+        needsFullSave = false;
+    }
+
+    // Find student by roll number
+    int findStudentIndex(int rollNo) {
+        SMS_TIMED(FindIndex);
+        if (sharded.isOpen()) return sharded.find(rollNo);
+        if (compressed.isOpen()) return compressed.indexOf(rollNo);
+        if (!indexBuilt) rebuildIndex();
+        return rollIndex.find(rollNo);
+    }
+
+    // Utility function to clear invalid input
+    void clearCin() {
+        cin.clear();
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    }
+
+    // Concurrency: mutations hold rosterLock exclusively, queries share it.
+    // The lazy structures (roll index, marks/name indexes, running stats)
+    // are built by whichever query first needs one, under the exclusive lock.
+    mutable shared_mutex rosterLock;
+
+    bool rollIndexReady() const { return indexBuilt || sharded.isOpen() || compressed.isOpen(); }
+    bool marksIndexReady() const { return rollIndexReady() && marksIndexBuilt; }
+    bool nameIndexReady() const { return rollIndexReady() && nameIndexBuilt && !nameIndex.needsRebuild(); }
+#ifdef SMS_VERIFY_STATS
+    bool statsReady() const { return statsBuilt && students.deadCount() == 0; }   // verifyStats compacts
+#else
+    bool statsReady() const { return statsBuilt; }
+#endif
+
+    // Run `read` under the shared lock if `ready()` says it won't build
+    // anything; otherwise run it exclusively and let it build
+    template <typename Ready, typename Read>
+    auto readShared(Ready ready, Read read) -> decltype(read()) {
+        {
+            shared_lock<shared_mutex> lock(rosterLock);
+            if (ready()) return read();
+        }
+        unique_lock<shared_mutex> lock(rosterLock);
+        return read();
+    }
+
+public:
+    // Constructor
+    StudentManagementSystem() {
+        try {
+            loadFromFile();
+        }
+        catch (const exception& e) {
+            cout << "Initialization error: " << e.what() << endl;
+        }
+        flusher = thread(&StudentManagementSystem::flusherLoop, this);
+        if (needsFullSave) requestFlush();
+        maybeCompact();   // a long journal left by the last session
+    }
+
+    // Destructor: changes are already journaled, so exit only joins a flush
+    // in progress and makes the last batch durable. A file still in legacy
+    // (or unreadable) form is rewritten here if the flusher never got to it.
+    ~StudentManagementSystem() {
+        {
+            lock_guard<mutex> guard(flushLock);
+            shuttingDown = true;
+        }
+        flushWake.notify_one();
+        flusher.join();
+        if (!flushError.empty()) cout << "Warning: background save failed: " << flushError << endl;
+
+        try {
+            if (needsFullSave) {
+                saveToFile();
+            }
+            else {
+                journal.sync();
+                cout << "Data saved successfully. " << recordCount() << " records stored." << endl;
+            }
+        }
+        catch (const exception& e) {
+            cout << "Shutdown error: " << e.what() << endl;
+        }
+    }
+
+    // Make all journaled changes durable (one fsync for the whole batch)
+    void sync() {
+        unique_lock<shared_mutex> lock(rosterLock);
+        journal.sync();
+    }
+
+    // Split the roster across n data files (1 = a single students.dat);
+    // the new layout is written by the next background save
+    void setShardCount(size_t n) {
+        if (n == 0 || n > MAX_SHARDS) {
+            throw StudentException("Shard count must be between 1 and " + to_string(MAX_SHARDS));
+        }
+        {
+            unique_lock<shared_mutex> lock(rosterLock);
+            if (n > 1 && packedFormat) throw StudentException("Shards use the binary format; switch to it first");
+            if (n == shardCount) return;
+            shardCount = n;
+            needsFullSave = true;
+        }
+        requestFlush();
+    }
+
+    // Save students.dat compressed (true) or in the mapped binary format;
+    // like setShardCount, the next background save rewrites it
+    void setPackedFormat(bool packed) {
+        {
+            unique_lock<shared_mutex> lock(rosterLock);
+            if (packed && shardCount > 1) throw StudentException("Compressed storage is single-file only");
+            if (packed == packedFormat) return;
+            packedFormat = packed;
+            needsFullSave = true;
+        }
+        requestFlush();
+    }
+
+    // Hold journal entries until sync() instead of syncing every few dozen
+    void setDeferredSync(bool deferred) {
+        unique_lock<shared_mutex> lock(rosterLock);
+        journal.setSyncBatch(deferred ? 0 : Journal::DEFAULT_SYNC_BATCH);
+    }
+
+    // ---- Replication (see Server and Replica) ----
+    // Keep the newest `bytes` of journal frames for followers to stream
+    void enableReplication(size_t bytes = REPLICATION_BACKLOG_BYTES) {
+        unique_lock<shared_mutex> lock(rosterLock);
+        replicationLog.enable(lastSeq, bytes);
+    }
+
+    // Sequence number of the newest change; a follower's matches its primary's
+    uint64_t journalSeq() const {
+        shared_lock<shared_mutex> lock(rosterLock);
+        return lastSeq;
+    }
+
+    bool isReplica() const {
+        shared_lock<shared_mutex> lock(rosterLock);
+        return replica;
+    }
+
+    // A follower refuses every change except its primary's. Promotion just
+    // clears the flag: the roster in memory is already current, so the
+    // node takes writes straight away, with no reload.
+    void setReplica(bool follower) {
+        unique_lock<shared_mutex> lock(rosterLock);
+        replica = follower;
+        journal.sync();
+    }
+
+    // Frames of the durable commits after `seq`, for a follower (see
+    // ReplicationLog::readAfter)
+    bool replicationSince(uint64_t& seq, string& out, size_t maxBytes) const {
+        shared_lock<shared_mutex> lock(rosterLock);
+        return replicationLog.readAfter(seq, journal.durableSeq(), out, maxBytes);
+    }
+
+    // Apply whole commits streamed from the primary, under its sequence
+    // numbers, and journal them like local changes. Throws at the first
+    // commit that does not follow on from journalSeq() or does not apply;
+    // the ones before it stay applied.
+    void applyReplicated(const vector<JournalEntry>& entries) {
+        SMS_TIMED(Replicate);
+        unique_lock<shared_mutex> lock(rosterLock);
+        for (size_t i = 0; i < entries.size(); i++) {
+            const JournalEntry& e = entries[i];
+            if (e.seq != lastSeq + 1) {
+                throw StudentException("Expected change " + to_string(lastSeq + 1) + ", got " + to_string(e.seq));
+            }
+            size_t n = e.op == JournalOp::Begin ? static_cast<size_t>(max(e.rollNo, 0)) : 0;
+            if (n > entries.size() - i - 1) throw StudentException("Transaction at change " + to_string(e.seq) + " is cut short");
+            try {
+                if (e.op == JournalOp::Begin) {
+                    vector<RecordChange> changes;
+                    changes.reserve(n);
+                    for (size_t k = 1; k <= n; k++) {
+                        const JournalEntry& u = entries[i + k];
+                        if (u.op != JournalOp::Update || u.seq != e.seq + k) throw StudentException("Malformed transaction");
+                        changes.push_back(RecordChange{u.rollNo, u.name, u.marks});
+                    }
+                    if (n > 0) applyUpdateBatch(changes);
+                }
+                else {
+                    applyEntry(e);
+                }
+            }
+            catch (const StudentException& failure) {
+                throw StudentException("Change " + to_string(e.seq) + " does not apply: " + failure.what());
+            }
+            for (size_t k = 0; k <= n; k++) {
+                const JournalEntry& applied = entries[i + k];
+                journalEntry(applied.seq, applied.op, applied.rollNo, applied.marks, applied.name);
+            }
+            i += n;
+            lastSeq = entries[i].seq;
+            replicationLog.commit(lastSeq);
+        }
+        journal.sync();
+        maybeCompact();
+    }
+
+    // Replace the roster with a primary's snapshot as of change `seq`. The
+    // old journal goes first and the new roster is then written in full, so
+    // a crash part way leaves either the old roster as last saved or the
+    // new one. The files, the roll number index and the snapshot chunks are
+    // all made with no lock held; the exclusive section only swaps them in.
+    void installSnapshot(StudentStore records, uint64_t seq) {
+        SMS_TIMED(Replicate);
+        lock_guard<mutex> saving(saveLock);
+        size_t shards;
+        bool packed;
+        uint64_t generation;
+        vector<string> previousFiles;
+        {
+            unique_lock<shared_mutex> lock(rosterLock);
+            journal.reset();
+            filesystem::remove(OLD_JOURNAL_FILE);
+            shards = shardCount;
+            packed = packedFormat;
+            generation = shardGeneration + 1;
+            previousFiles = layoutFiles;
+        }
+
+        vector<string> files = writeRoster(records, seq, shards, generation, packed, previousFiles);
+        uint64_t bytes = totalFileSize(files);
+        RollIndex index;
+        index.reserve(records.size());
+        for (size_t i = 0; i < records.size(); i++) index.insert(records.rollNoAt(i), static_cast<int>(i));
+        vector<shared_ptr<SnapshotChunk>> chunks;
+        copyChunks(records, chunks, 0);
+
+        unique_lock<shared_mutex> lock(rosterLock);
+        mapped.close();
+        sharded.close();
+        compressed.close();
+        students = move(records);
+        rollIndex = move(index);
+        indexBuilt = true;
+        snapshotChunks = move(chunks);
+        publishedChunks.reset();
+        invalidateSecondaryIndexes();
+        lastSeq = savedSeq = seq;
+        snapshotBytes = bytes;
+        shardGeneration = generation;
+        layoutFiles = move(files);
+        needsFullSave = shardCount != shards || packedFormat != packed;
+        replicationLog.reset(seq);
+    }
+
+    // ---- Non-interactive operations (batch mode) ----
+    // Same validation as the menu handlers, but errors are thrown to the
+    // caller and nothing is printed on success. All of them are safe to
+    // call from several threads at once.
+    void addRecord(string_view name, int rollNo, float marks) {
+        SMS_TIMED(Add);
+        if (name.empty()) throw StudentException("Name cannot be empty");
+        unique_lock<shared_mutex> lock(rosterLock);
+        checkWritable();
+        if (findStudentIndex(rollNo) != -1) {
+            throw StudentException("Student with this Roll No already exists");
+        }
+        insertRecord(name, rollNo, marks);
+        logChange(JournalOp::Add, rollNo, name, marks);
+    }
+
+    void updateRecordByRoll(int rollNo, string_view name, float marks) {
+        SMS_TIMED(Update);
+        unique_lock<shared_mutex> lock(rosterLock);
+        checkWritable();
+        int index = findStudentIndex(rollNo);
+        if (index == -1) throw StudentException("Student not found");
+        updateRecord(index, name, marks);
+        logChange(JournalOp::Update, rollNo, name, marks);
+    }
+
+    void deleteRecord(int rollNo) {
+        SMS_TIMED(Delete);
+        unique_lock<shared_mutex> lock(rosterLock);
+        checkWritable();
+        int index = findStudentIndex(rollNo);
+        if (index == -1) throw StudentException("Student not found");
+        removeRecord(index);
+        logChange(JournalOp::Delete, rollNo);
+    }
+
+    // Update many records as one transaction. Every change is validated
+    // first (known roll number, listed once, valid name and marks); if any
+    // fails nothing is applied. The journal frames the changes with a Begin
+    // entry, so replay after a crash also applies all or none of them.
+    void updateRecords(const vector<RecordChange>& changes) {
+        SMS_TIMED(BatchUpdate);
+        if (changes.empty()) return;
+        unique_lock<shared_mutex> lock(rosterLock);
+        checkWritable();
+        vector<int> slots;
+        vector<string> names;
+        vector<float> marks;
+        resolveUpdates(changes, slots, names, marks);
+        applyUpdates(slots, names, marks);
+
+        size_t syncBatch = journal.syncBatchSize();
+        journal.setSyncBatch(0);   // keep the transaction in one write
+        journalEntry(++lastSeq, JournalOp::Begin, static_cast<int>(slots.size()), 0.0f, string_view());
+        for (size_t i = 0; i < slots.size(); i++) {
+            journalEntry(++lastSeq, JournalOp::Update, students.rollNoAt(slots[i]), marks[i], names[i]);
+        }
+        replicationLog.commit(lastSeq);
+        journal.setSyncBatch(syncBatch);
+        if (syncBatch != 0) journal.sync();
+        maybeCompact();
+    }
+
+    // Bulk import from CSV, IMPORT_BATCH rows at a time. Each batch goes in
+    // under one exclusive section: rows whose roll number is already taken
+    // are rejected, the rest are appended and journaled, and the journal is
+    // synced once. The secondary indexes are dropped instead of updated row
+    // by row, and rebuilt once by the next query that needs them.
+    ImportSummary importCsv(const string& path, const string& rejectsPath) {
+        SMS_TIMED(Import);
+        const size_t IMPORT_BATCH = 65536;
+        CsvReader reader(path);
+        RejectLog rejectLog(rejectsPath);
+        StudentStore rows;
+        vector<uint64_t> lines;
+        vector<CsvReject> rejects;
+        ImportSummary summary;
+        for (bool more = true; more;) {
+            rows.clear();
+            lines.clear();
+            rejects.clear();
+            more = reader.readBatch(rows, lines, rejects, IMPORT_BATCH);
+            {
+                unique_lock<shared_mutex> lock(rosterLock);
+                checkWritable();
+                materialize();
+                if (!indexBuilt) rebuildIndex();
+                students.reserve(students.size() + rows.size());
+                rollIndex.reserve(students.size() + rows.size());
+                size_t syncBatch = journal.syncBatchSize();
+                journal.setSyncBatch(0);
+                size_t added = 0;
+                for (size_t i = 0; i < rows.size(); i++) {
+                    int rollNo = rows.rollNoAt(i);
+                    if (rollIndex.find(rollNo) != -1) {
+                        ostringstream row;
+                        TableWriter(row, TableFormat::CSV).row(rows.nameAt(i), rollNo, rows.marksAt(i));
+                        string text = row.str();
+                        text.pop_back();
+                        rejects.push_back(CsvReject{lines[i], "Student with this Roll No already exists", move(text)});
+                        continue;
+                    }
+                    students.append(rows.nameAt(i), rollNo, rows.marksAt(i));
+                    refreshSnapshotChunks(students.size() - 1);
+                    rollIndex.insert(rollNo, static_cast<int>(students.size()) - 1);
+                    journalEntry(++lastSeq, JournalOp::Add, rollNo, rows.marksAt(i), rows.nameAt(i));
+                    added++;
+                }
+                replicationLog.commit(lastSeq);
+                journal.setSyncBatch(syncBatch);
+                if (added > 0) invalidateSecondaryIndexes();
+                journal.sync();
+                maybeCompact();
+                summary.imported += added;
+            }
+            sort(rejects.begin(), rejects.end(), [](const CsvReject& a, const CsvReject& b) { return a.line < b.line; });
+            rejectLog.write(rejects);
+        }
+        summary.rejected = rejectLog.size();
+        return summary;
+    }
+
+    // Copy of one record, or nothing if the roll number is unknown
+    optional<Student> lookup(int rollNo) {
+        SMS_TIMED(Search);
+        return readShared([this] { return rollIndexReady(); }, [&]() -> optional<Student> {
+            int index = findStudentIndex(rollNo);
+            if (index == -1) return nullopt;
+            return Student(string(nameAt(index)), rollNo, marksAt(index));
+        });
+    }
+
+    void printRecord(int rollNo, ostream& out = cout) {
+        SMS_TIMED(Search);
+        readShared([this] { return rollIndexReady(); }, [&] {
+            int index = findStudentIndex(rollNo);
+            if (index == -1) throw StudentException("Student not found");
+            displayRecord(index, out);
+        });
+    }
+
+    // Current marks aggregates (count is 0 for an empty roster)
+    MarksSummary statistics() {
+        SMS_TIMED(Statistics);
+        return readShared([this] { return statsReady(); }, [this] {
+            ensureStats();
+            MarksSummary summary = stats.summary();
+#ifdef SMS_VERIFY_STATS
+            verifyStats(summary);
+#endif
+            return summary;
+        });
+    }
+
+    // Percentiles (each 0-100) of the marks, read off the histogram
+    vector<double> marksPercentiles(const vector<double>& ps) {
+        return marksReport(ps).percentiles;
+    }
+
+    // Aggregates and percentiles read in one locked section, so both
+    // describe the same roster even with writers running; the percentiles
+    // are left empty for an empty roster
+    MarksReport marksReport(const vector<double>& ps) {
+        for (double p : ps) {
+            if (!(p >= 0 && p <= 100)) throw StudentException("Percentile must be between 0 and 100");
+        }
+        SMS_TIMED(Statistics);
+        return readShared([this] { return statsReady(); }, [&] {
+            ensureStats();
+            MarksReport report;
+            report.summary = stats.summary();
+            if (report.summary.count > 0) {
+                report.percentiles.reserve(ps.size());
+                for (double p : ps) report.percentiles.push_back(stats.percentile(p));
+            }
+#ifdef SMS_VERIFY_STATS
+            verifyStats(report.summary);
+            if (report.summary.count > 0) verifyPercentiles(ps, report.percentiles);
+#endif
+            return report;
+        });
+    }
+
+    // Student counts per band of `width` marks (see MarksHistogram::bands)
+    vector<uint64_t> marksHistogram(float width) {
+        SMS_TIMED(Statistics);
+        return readShared([this] { return statsReady(); }, [&] {
+            ensureStats();
+            return stats.bands(width);
+        });
+    }
+
+    // ---- Name search, answered from the trigram index ----
+    // Roll numbers (ascending) of students whose name contains `query`, or
+    // starts with it when `prefix` is set; case-insensitive
+    vector<int> findByName(string_view query, bool prefix) {
+        if (query.empty()) throw StudentException("Search text cannot be empty");
+        SMS_TIMED(NameSearch);
+        return readShared([this] { return nameIndexReady(); }, [&] { return matchNames(query, prefix); });
+    }
+
+    void listByName(string_view query, bool prefix, TableFormat format = TableFormat::Table, ostream& out = cout) {
+        printRolls(findByName(query, prefix), format, out);
+    }
+
+    // Rows for the given roll numbers; ones deleted in the meantime are skipped
+    void printRolls(const vector<int>& rollNos, TableFormat format = TableFormat::Table, ostream& out = cout) {
+        readShared([this] { return rollIndexReady(); }, [&] {
+            TableWriter writer(out, format);
+            writer.header();
+            for (int rollNo : rollNos) {
+                int index = findStudentIndex(rollNo);
+                if (index != -1) writer.row(nameAt(index), rollNo, marksAt(index));
+            }
+        });
+    }
+
+    // ---- Marks queries, answered from the marks index ----
+    size_t countMarksRange(float lo, float hi) {
+        if (hi < lo) throw StudentException("Lower bound must not exceed upper bound");
+        SMS_TIMED(MarksQuery);
+        return readShared([this] { return marksIndexReady(); }, [&] {
+            ensureMarksIndex();
+            return marksIndex.countRange(lo, hi);
+        });
+    }
+
+    void listMarksRange(float lo, float hi, TableFormat format = TableFormat::Table, ostream& out = cout) {
+        if (hi < lo) throw StudentException("Lower bound must not exceed upper bound");
+        SMS_TIMED(MarksQuery);
+        readShared([this] { return marksIndexReady(); }, [&] {
+            ensureMarksIndex();
+            TableWriter writer(out, format);
+            writer.header();
+            marksIndex.forEachInRange(lo, hi, [&](const MarksKey& k) {
+                writer.row(nameAt(findStudentIndex(k.rollNo)), k.rollNo, k.marks);
+            });
+        });
+    }
+
+    void listTopMarks(size_t k, TableFormat format = TableFormat::Table, ostream& out = cout) {
+        if (k == 0) throw StudentException("K must be positive");
+        SMS_TIMED(MarksQuery);
+        readShared([this] { return marksIndexReady(); }, [&] {
+            ensureMarksIndex();
+            TableWriter writer(out, format);
+            writer.header();
+            marksIndex.forEachTop(k, [&](const MarksKey& key) {
+                writer.row(nameAt(findStudentIndex(key.rollNo)), key.rollNo, key.marks);
+            });
+        });
+    }
+
+    // Add new student with comprehensive input validation
+    void addStudent() {
+        try {
+            string name;
+            int rollNo;
+            float marks;
+
+            cout << "\nEnter Student Details:\n";
+            cout << "Name: ";
+            cin.ignore();
+            getline(cin, name);
+            if (name.empty()) throw StudentException("Name cannot be empty");
+
+            cout << "Roll No: ";
+            if (!(cin >> rollNo)) {
+                clearCin();
+                throw StudentException("Invalid input for roll number");
+            }
+            if (rollNo < 0) throw StudentException("Roll number cannot be negative");
+
+            cout << "Marks: ";
+            if (!(cin >> marks)) {
+                clearCin();
+                throw StudentException("Invalid input for marks");
+            }
+            if (marks < 0 || marks > 100) throw StudentException("Marks must be between 0-100");
+
+            addRecord(name, rollNo, marks);
+            cout << "Student added successfully!" << endl;
+        }
+        catch (const StudentException& e) {
+            cout << "Error: " << e.what() << endl;
+        }
+        catch (...) {
+            cout << "Unexpected error occurred while adding student" << endl;
+        }
+    }
+
+    // Consistent read-only copy of the roster, in insertion order or
+    // sorted. Costs a copy of the chunk pointers (nothing when nothing
+    // changed since the last one); the caller then reads it without
+    // holding anything, so writers never wait on a long report.
+    RosterSnapshot snapshot(SortKey order = SortKey::Insertion) {
+        shared_lock<shared_mutex> lock(rosterLock);
+        // A missing view is sorted under the exclusive lock; check again
+        // once shared, in case a change dropped it in between
+        shared_ptr<const vector<uint32_t>> view;
+        while (order != SortKey::Insertion && !(view = orderedView(order))) {
+            lock.unlock();
+            {
+                unique_lock<shared_mutex> exclusive(rosterLock);
+                ensureOrderedView(order);
+            }
+            lock.lock();
+        }
+        return RosterSnapshot(publishChunks(), move(view), recordCount(), lastSeq);
+    }
+
+    // Display all students. Rows are rendered into a buffer and written in
+    // large blocks; pageSize > 0 pauses after every page (table format on
+    // the console only). The listing reads a snapshot, so paging or a slow
+    // output file holds no lock.
+    void displayAll(TableFormat format = TableFormat::Table, size_t pageSize = 0, ostream& out = cout,
+                    SortKey order = SortKey::Insertion) {
+        SMS_TIMED(Display);
+        RosterSnapshot roster = snapshot(order);
+        if (roster.size() == 0) {
+            if (format == TableFormat::Table) out << "No students found!" << endl;
+            return;
+        }
+
+        TableWriter writer(out, format);
+        writer.header();
+        size_t shown = 0;
+        roster.forEach([&](string_view name, int rollNo, float marks) {
+            writer.row(name, rollNo, marks);
+            shown++;
+            bool pageFull = pageSize > 0 && format == TableFormat::Table && &out == &cout && shown % pageSize == 0;
+            if (pageFull && shown < roster.size()) {
+                writer.flush();
+                cout << "-- " << shown << "/" << roster.size() << " -- Enter for more, q to stop: " << flush;
+                string answer;
+                return getline(cin, answer) && answer != "q" && answer != "Q";
+            }
+            return true;
+        });
+    }
+
+    // Search student by roll number with input validation
+    void searchStudent() {
+        try {
+            int rollNo;
+            cout << "Enter Roll No to search: ";
+            if (!(cin >> rollNo)) {
+                clearCin();
+                throw StudentException("Invalid input for roll number");
+            }
+
+            optional<Student> found = lookup(rollNo);
+            if (!found) {
+                throw StudentException("Student not found");
+            }
+
+            cout << "\nStudent Found:" << endl;
+            cout << left << setw(20) << "Name" << setw(10) << "Roll No" << setw(10) << "Marks" << endl;
+            cout << "----------------------------------------" << endl;
+            displayRow(found->getName(), found->getRollNo(), found->getMarks());
+        }
+        catch (const StudentException& e) {
+            cout << "Error: " << e.what() << endl;
+        }
+    }
+
+    // Update student details with validation
+    void updateStudent() {
+        try {
+            int rollNo;
+            cout << "Enter Roll No to update: ";
+            if (!(cin >> rollNo)) {
+                clearCin();
+                throw StudentException("Invalid input for roll number");
+            }
+
+            if (!lookup(rollNo)) {
+                throw StudentException("Student not found");
+            }
+
+            string name;
+            float marks;
+
+            cout << "Enter new Name: ";
+            cin.ignore();
+            getline(cin, name);
+            if (name.empty()) throw StudentException("Name cannot be empty");
+
+            cout << "Enter new Marks: ";
+            if (!(cin >> marks)) {
+                clearCin();
+                throw StudentException("Invalid input for marks");
+            }
+            if (marks < 0 || marks > 100) throw StudentException("Marks must be between 0-100");
+
+            updateRecordByRoll(rollNo, name, marks);
+            cout << "Student details updated successfully!" << endl;
+        }
+        catch (const StudentException& e) {
+            cout << "Error: " << e.what() << endl;
+        }
+    }
+
+    // Delete student with validation
+    void deleteStudent() {
+        try {
+            int rollNo;
+            cout << "Enter Roll No to delete: ";
+            if (!(cin >> rollNo)) {
+                clearCin();
+                throw StudentException("Invalid input for roll number");
+            }
+
+            deleteRecord(rollNo);
+            cout << "Student deleted successfully!" << endl;
+        }
+        catch (const StudentException& e) {
+            cout << "Error: " << e.what() << endl;
+        }
+    }
+
+#ifdef SMS_VERIFY_STATS
+    // Debug builds (-DSMS_VERIFY_STATS): cross-check the running aggregates
+    // against a full recompute over the marks column
+    void verifyStats(const MarksSummary& running) {
+        compactStore();
+        MarksSummary full;
+        forEachMarksColumn([&](const float* marks, size_t n) {
+            if (n == 0) return;
+            MarksSummary piece = summarizeMarks(marks, n);
+            full.minMarks = full.count ? min(full.minMarks, piece.minMarks) : piece.minMarks;
+            full.maxMarks = full.count ? max(full.maxMarks, piece.maxMarks) : piece.maxMarks;
+            full.count += piece.count;
+            full.sum += piece.sum;
+            full.sumSquares += piece.sumSquares;
+        });
+        double tolerance = 1e-9 * max(1.0, fabs(full.sumSquares));
+        bool ok = running.count == full.count
+               && running.minMarks == full.minMarks && running.maxMarks == full.maxMarks
+               && fabs(running.sum - full.sum) <= tolerance
+               && fabs(running.sumSquares - full.sumSquares) <= tolerance;
+        if (!ok) {
+            cerr << "Statistics verification FAILED: running count/sum/min/max "
+                 << running.count << "/" << running.sum << "/" << running.minMarks << "/" << running.maxMarks
+                 << " vs recomputed " << full.count << "/" << full.sum << "/" << full.minMarks << "/" << full.maxMarks << endl;
+            abort();
+        }
+    }
+
+    // ... and the percentiles against a sorted copy of the column
+    void verifyPercentiles(const vector<double>& ps, const vector<double>& values) {
+        vector<float> all;
+        all.reserve(recordCount());
+        forEachMarksColumn([&](const float* marks, size_t n) { all.insert(all.end(), marks, marks + n); });
+        sort(all.begin(), all.end());
+        for (size_t i = 0; i < ps.size(); i++) {
+            double expected = 0;
+            if (!all.empty()) {
+                double rank = ps[i] / 100.0 * double(all.size() - 1);
+                size_t k = static_cast<size_t>(rank);
+                double low = all[k];
+                double frac = rank - double(k);
+                expected = frac > 0 ? low + frac * (double(all[k + 1]) - low) : low;
+            }
+            if (values[i] != expected) {
+                cerr << "Percentile verification FAILED: p" << ps[i] << " is " << values[i]
+                     << " vs recomputed " << expected << endl;
+                abort();
+            }
+        }
+    }
+#endif
+
+    // Search by full or partial name
+    void searchByName() {
+        try {
+            string query;
+            int mode;
+            cout << "Enter name or part of a name: ";
+            cin.ignore();
+            getline(cin, query);
+            string_view text = trimSpaces(query);
+            if (text.empty()) throw StudentException("Search text cannot be empty");
+
+            cout << "Match 1. anywhere in the name  2. start of the name: ";
+            if (!(cin >> mode) || (mode != 1 && mode != 2)) {
+                clearCin();
+                throw StudentException("Invalid option");
+            }
+
+            vector<int> found = findByName(text, mode == 2);
+            if (found.empty()) throw StudentException("No matching students");
+            cout << "\n" << found.size() << " matching students:";
+            printRolls(found);
+        }
+        catch (const StudentException& e) {
+            cout << "Error: " << e.what() << endl;
+        }
+    }
+
+    // Range counts, range listings and top-K by marks
+    void marksQueries() {
+        try {
+            int option;
+            cout << "\n1. Count students in a marks range" << endl;
+            cout << "2. List students in a marks range" << endl;
+            cout << "3. Top K students by marks" << endl;
+            cout << "Enter option (1-3): ";
+            if (!(cin >> option)) {
+                clearCin();
+                throw StudentException("Invalid option");
+            }
+
+            if (option == 1 || option == 2) {
+                float lo, hi;
+                cout << "Lowest marks: ";
+                if (!(cin >> lo)) {
+                    clearCin();
+                    throw StudentException("Invalid input for marks");
+                }
+                cout << "Highest marks: ";
+                if (!(cin >> hi)) {
+                    clearCin();
+                    throw StudentException("Invalid input for marks");
+                }
+                if (option == 1) {
+                    cout << countMarksRange(lo, hi) << " students have marks between " << lo << " and " << hi << endl;
+                }
+                else {
+                    listMarksRange(lo, hi);
+                }
+            }
+            else if (option == 3) {
+                int k;
+                cout << "How many students: ";
+                if (!(cin >> k) || k <= 0) {
+                    clearCin();
+                    throw StudentException("Invalid input for K");
+                }
+                listTopMarks(k);
+            }
+            else {
+                throw StudentException("Invalid option");
+            }
+        }
+        catch (const StudentException& e) {
+            cout << "Error: " << e.what() << endl;
+        }
+    }
+
+    // Show statistics (constant time once the running aggregates exist)
+    void showStatistics(ostream& out = cout) {
+        MarksReport report = marksReport({25, 50, 75});
+        const MarksSummary& summary = report.summary;
+        if (summary.count == 0) {
+            out << "No students found!" << endl;
+            return;
+        }
+
+        out << "\n--- Statistics ---" << endl;
+        out << "Total Students: " << summary.count << endl;
+        out << "Average Marks: " << fixed << setprecision(2) << summary.mean() << endl;
+        out << "Highest Marks: " << summary.maxMarks << endl;
+        out << "Lowest Marks: " << summary.minMarks << endl;
+        out << "Std Deviation: " << sqrt(summary.variance()) << endl;
+        const vector<double>& quartiles = report.percentiles;
+        out << "Median Marks: " << quartiles[1] << endl;
+        out << "Quartiles (Q1 / Q3): " << quartiles[0] << " / " << quartiles[2] << endl;
+    }
+
+    void showPercentiles(const vector<double>& ps, ostream& out = cout) {
+        MarksReport report = marksReport(ps);
+        if (report.summary.count == 0) {
+            out << "No students found!" << endl;
+            return;
+        }
+        const vector<double>& values = report.percentiles;
+        for (size_t i = 0; i < ps.size(); i++) {
+            out << "P" << defaultfloat << setprecision(6) << ps[i] << ": " << fixed << setprecision(2) << values[i] << endl;
+        }
+    }
+
+    // Grade distribution in bands of `width` marks, with a bar per band
+    void showHistogram(float width, ostream& out = cout) {
+        vector<uint64_t> bands = marksHistogram(width);
+        uint64_t most = *max_element(bands.begin(), bands.end());
+        if (most == 0) {
+            out << "No students found!" << endl;
+            return;
+        }
+        double step = lround(double(width) * 100.0) / 100.0;
+        out << "\n--- Grade Histogram ---" << endl << fixed << setprecision(2);
+        for (size_t i = 0; i < bands.size(); i++) {
+            bool last = i + 1 == bands.size();
+            size_t bar = static_cast<size_t>((bands[i] * 40 + most - 1) / most);
+            out << "[" << setw(6) << i * step << ", " << setw(6) << (last ? 100.0 : (i + 1) * step) << (last ? "]" : ")")
+                << setw(10) << bands[i] << "  " << string(bar, '#') << endl;
+        }
+    }
+
+    // Statistics menu: summary, percentiles or the grade histogram
+    void statisticsMenu() {
+        try {
+            int option;
+            cout << "\n1. Summary (average, spread, quartiles)" << endl;
+            cout << "2. Percentiles" << endl;
+            cout << "3. Grade histogram" << endl;
+            cout << "Enter option (1-3): ";
+            if (!(cin >> option)) {
+                clearCin();
+                throw StudentException("Invalid option");
+            }
+
+            if (option == 1) {
+                showStatistics();
+            }
+            else if (option == 2) {
+                string line;
+                cout << "Percentiles (0-100, separated by spaces): ";
+                cin >> ws;
+                getline(cin, line);
+                istringstream in(line);
+                vector<double> ps;
+                double p;
+                while (in >> p) ps.push_back(p);
+                if (ps.empty() || !in.eof()) throw StudentException("Invalid input for percentile");
+                showPercentiles(ps);
+            }
+            else if (option == 3) {
+                float width;
+                cout << "Band width in marks (e.g. 10): ";
+                if (!(cin >> width)) {
+                    clearCin();
+                    throw StudentException("Invalid input for band width");
+                }
+                showHistogram(width);
+            }
+            else {
+                throw StudentException("Invalid option");
+            }
+        }
+        catch (const StudentException& e) {
+            cout << "Error: " << e.what() << endl;
+        }
+    }
+};
+
+// ========== Batch Mode ==========
+// Non-interactive command stream, one command per line:
+//   ADD <rollNo> <marks> <name...>
+//   UPD <rollNo> <marks> <name...>
+//   DEL <rollNo>
+//   GET <rollNo>
+//   STATS
+//   LIST [table|csv|tsv] [order]      order: name, roll or marks (highest first)
+//   COUNT <lo> <hi>                   students with lo <= marks <= hi
+//   RANGE <lo> <hi> [table|csv|tsv]   list them in ascending marks order
+//   TOP <k> [table|csv|tsv]           k highest marks, descending
+//   FIND <text...>                    names containing text (any case)
+//   PREFIX <text...>                  names starting with text
+//   PERF                              performance counters (-DSMS_INSTRUMENT)
+//   GRADES <rollNo>:<marks>...        set many marks as one transaction
+//   PCTL <p>...                       marks percentiles (0-100)
+//   HIST [width]                      grade histogram, bands of width marks (10)
+// Blank lines and lines starting with '#' are ignored. Every change is
+// journaled, and the whole run is synced once at the end.
+string_view nextToken(string_view& rest) {
+    size_t b = rest.find_first_not_of(" \t");
+    if (b == string_view::npos) {
+        rest = string_view();
+        return rest;
+    }
+    size_t e = rest.find_first_of(" \t", b);
+    string_view token = rest.substr(b, e == string_view::npos ? string_view::npos : e - b);
+    rest = e == string_view::npos ? string_view() : rest.substr(e);
+    return token;
+}
+
+template <typename T>
+T parseNumber(string_view token, const char* what) {
+    T value{};
+    auto r = from_chars(token.data(), token.data() + token.size(), value);
+    if (token.empty() || r.ec != errc() || r.ptr != token.data() + token.size()) {
+        throw StudentException(string("Invalid input for ") + what);
+    }
+    return value;
+}
+
+const char* const BATCH_VERBS[] = {"ADD", "UPD", "DEL", "GET", "STATS", "LIST", "COUNT", "RANGE", "TOP",
+                                   "FIND", "PREFIX", "PERF", "GRADES", "PCTL", "HIST"};
+const size_t BATCH_VERB_COUNT = sizeof(BATCH_VERBS) / sizeof(BATCH_VERBS[0]);
+
+// Run one command (verb already split off) and return the verb's index
+// in BATCH_VERBS. Output goes to `out`; errors are thrown.
+size_t runCommand(StudentManagementSystem& sms, string_view verb, string_view rest, ostream& out) {
+    size_t v = find(BATCH_VERBS, BATCH_VERBS + BATCH_VERB_COUNT, verb) - BATCH_VERBS;
+    switch (v) {
+        case 0:   // ADD
+        case 1: { // UPD
+            int rollNo = parseNumber<int>(nextToken(rest), "roll number");
+            float marks = parseNumber<float>(nextToken(rest), "marks");
+            string_view name = trimSpaces(rest);
+            if (v == 0) sms.addRecord(name, rollNo, marks);
+            else sms.updateRecordByRoll(rollNo, name, marks);
+            break;
+        }
+        case 2: sms.deleteRecord(parseNumber<int>(nextToken(rest), "roll number")); break;
+        case 3: sms.printRecord(parseNumber<int>(nextToken(rest), "roll number"), out); break;
+        case 4: sms.showStatistics(out); break;
+        case 5: {   // LIST, the format and sort key in either order
+            TableFormat format = TableFormat::Table;
+            SortKey order = SortKey::Insertion;
+            for (string_view token = nextToken(rest); !token.empty(); token = nextToken(rest)) {
+                if (!parseSortKey(token, order)) format = parseTableFormat(token);
+            }
+            sms.displayAll(format, 0, out, order);
+            break;
+        }
+        case 6:   // COUNT
+        case 7: { // RANGE
+            float lo = parseNumber<float>(nextToken(rest), "marks");
+            float hi = parseNumber<float>(nextToken(rest), "marks");
+            if (v == 6) out << sms.countMarksRange(lo, hi) << "\n";
+            else sms.listMarksRange(lo, hi, parseTableFormat(nextToken(rest)), out);
+            break;
+        }
+        case 8: {
+            size_t k = parseNumber<size_t>(nextToken(rest), "K");
+            sms.listTopMarks(k, parseTableFormat(nextToken(rest)), out);
+            break;
+        }
+        case 9:   // FIND
+        case 10:  // PREFIX
+            sms.listByName(trimSpaces(rest), v == 10, TableFormat::Table, out);
+            break;
+        case 11: reportPerformance(out); break;
+        case 12: {
+            vector<RecordChange> changes;
+            for (string_view token = nextToken(rest); !token.empty(); token = nextToken(rest)) {
+                size_t colon = token.find(':');
+                if (colon == string_view::npos) {
+                    throw StudentException("Expected <rollNo>:<marks>, got '" + string(token) + "'");
+                }
+                changes.push_back(RecordChange{parseNumber<int>(token.substr(0, colon), "roll number"), nullopt,
+                                               parseNumber<float>(token.substr(colon + 1), "marks")});
+            }
+            if (changes.empty()) throw StudentException("GRADES needs at least one <rollNo>:<marks>");
+            sms.updateRecords(changes);
+            break;
+        }
+        case 13: {   // PCTL
+            vector<double> ps;
+            for (string_view token = nextToken(rest); !token.empty(); token = nextToken(rest)) {
+                ps.push_back(parseNumber<double>(token, "percentile"));
+            }
+            if (ps.empty()) throw StudentException("PCTL needs at least one percentile");
+            sms.showPercentiles(ps, out);
+            break;
+        }
+        case 14: {   // HIST
+            string_view width = nextToken(rest);
+            sms.showHistogram(width.empty() ? 10.0f : parseNumber<float>(width, "band width"), out);
+            break;
+        }
+        default: throw StudentException("Unknown command '" + string(verb) + "'");
+    }
+    return v;
+}
+
+// Verbs that change the roster (and so need a journal sync)
+bool isMutatingVerb(size_t v) { return v <= 2 || v == 12; }
+
+void runBatch(StudentManagementSystem& sms, istream& in) {
+    sms.setDeferredSync(true);
+    size_t ops = 0, errors = 0, lineNo = 0;
+    array<size_t, BATCH_VERB_COUNT> verbCounts{}, verbAllocations{};
+    string line;
+    auto start = chrono::steady_clock::now();
+
+    while (getline(in, line)) {
+        lineNo++;
+        string_view rest = trimSpaces(line);
+        if (rest.empty() || rest[0] == '#') continue;
+        string_view verb = nextToken(rest);
+        size_t v = BATCH_VERB_COUNT;
+        try {
+#ifdef SMS_COUNT_ALLOCATIONS
+            size_t allocationsBefore = allocationCount;
+#endif
+            v = runCommand(sms, verb, rest, cout);
+#ifdef SMS_COUNT_ALLOCATIONS
+            verbAllocations[v] += allocationCount - allocationsBefore;
+#endif
+            verbCounts[v]++;
+            ops++;
+        }
+        catch (const StudentException& e) {
+            errors++;
+            cerr << "line " << lineNo << ": " << e.what() << endl;
+        }
+    }
+
+    sms.sync();
+    sms.setDeferredSync(false);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    double seconds = max(elapsed.count(), 1e-9);
+    cerr << "Batch complete: " << ops << " commands, " << errors << " errors in "
+         << fixed << setprecision(3) << seconds * 1000 << " ms ("
+         << setprecision(0) << (ops + errors) / seconds << " ops/sec)" << endl;
+#ifdef SMS_COUNT_ALLOCATIONS
+    for (size_t i = 0; i < BATCH_VERB_COUNT; i++) {
+        if (verbCounts[i] == 0) continue;
+        cerr << "  " << left << setw(6) << BATCH_VERBS[i] << right << verbCounts[i] << " commands, "
+             << verbAllocations[i] << " heap allocations" << endl;
+    }
+#else
+    (void)verbAllocations;
+#endif
+#ifdef SMS_INSTRUMENT
+    reportPerformance(cerr);
+#endif
+}
+
+// ========== Replication ==========
+// Log shipping from a primary to read-only followers. Each follower keeps
+// its own copy of the roster, with its own students.dat and journal,
+// under the primary's sequence numbers. It connects to the primary's
+// server port and sends
+//   REPLICATE [seq]        seq: newest change it has (none: start over)
+// and the primary answers with one of
+//   STREAM <seq>                             the follower is current up to seq
+//   SNAPSHOT <seq> <records> <bytes>         a full copy as of seq follows:
+//                                            StudentSchema binary records
+// and from then on sends journal frames (the students.journal encoding) of
+// whole commits, once they are durable on the primary. A follower that
+// has to start over (a new follower, or one that fell out of the primary's
+// backlog or diverged from it) gets a snapshot. A follower serves queries
+// all along and can be promoted to primary as it stands.
+// A stream idle for REPLICATION_HEARTBEAT_MS gets a heartbeat: a blank line
+// while the snapshot is being prepared, a zero length word (never a valid
+// frame) after that. A follower that hears nothing for
+// REPLICATION_TIMEOUT_SECONDS drops the connection and reconnects.
+#ifdef SMS_HAVE_EPOLL
+const int REPLICATION_HEARTBEAT_MS = 1000;
+const int REPLICATION_TIMEOUT_SECONDS = 10;
+
+class Replica {
+private:
+    static const size_t MAX_FRAME_BYTES = 4 * 1024 * 1024;
+    static const uint64_t MAX_SNAPSHOT_BYTES = uint64_t(4) << 30;
+    static constexpr chrono::seconds RETRY_INTERVAL{1};
+
+    StudentManagementSystem& sms;
+    string primaryName;
+    sockaddr_in primary{};
+    thread worker;
+    mutex lock;                  // guards the two fields below
+    condition_variable wake;
+    int socketFd = -1;           // current connection, shut down by stop()
+    bool stopping = false;
+    atomic<bool> connected{false};
+    bool resync = false;         // our copy is unusable; ask for a snapshot
+
+    // Append whatever the primary sends next; throws once it is gone
+    static void receive(int fd, string& buffer) {
+        char chunk[64 * 1024];
+        ssize_t n;
+        do {
+            n = recv(fd, chunk, sizeof(chunk), 0);
+        } while (n < 0 && errno == EINTR);
+        if (n == 0) throw StudentException("primary closed the connection");
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            throw StudentException("primary sent nothing for " + to_string(REPLICATION_TIMEOUT_SECONDS) + " seconds");
+        }
+        if (n < 0) throw StudentException(string("receive failed: ") + strerror(errno));
+        buffer.append(chunk, n);
+    }
+
+    // A snapshot's records, checked like a loaded file. The caller has
+    // received all `bytes` and checked that `records` could fit in them.
+    static StudentStore decodeSnapshot(const char* p, size_t bytes, size_t records) {
+        const char* end = p + bytes;
+        StudentStore store;
+        store.reserve(records);
+        RollIndex seen;
+        seen.reserve(records);
+        StudentSchema::Values record;
+        for (size_t i = 0; i < records; i++) {
+            if (!StudentSchema::readBinary(p, end, record)) throw StudentException("snapshot is cut short");
+            StudentSchema::check(record);
+            if (seen.find(get<1>(record)) != -1) throw StudentException("snapshot repeats a roll number");
+            seen.insert(get<1>(record), static_cast<int>(i));
+            apply([&](auto... fields) { store.append(fields...); }, record);
+        }
+        if (p != end) throw StudentException("snapshot has trailing data");
+        return store;
+    }
+
+    // One connection: the handshake, then apply commits as they arrive
+    // until it drops
+    void follow(int fd) {
+        string request = resync ? string("REPLICATE\n") : "REPLICATE " + to_string(sms.journalSeq()) + "\n";
+        if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+            throw StudentException(string("send failed: ") + strerror(errno));
+        }
+
+        string buffer;
+        size_t newline;
+        for (;;) {
+            buffer.erase(0, min(buffer.find_first_not_of('\n'), buffer.size()));   // heartbeats
+            if ((newline = buffer.find('\n')) != string::npos) break;
+            if (buffer.size() > 256) throw StudentException("unexpected reply from primary");
+            receive(fd, buffer);
+        }
+        string_view rest = string_view(buffer).substr(0, newline);
+        string_view kind = nextToken(rest);
+        size_t pos = newline + 1;
+        if (kind == "SNAPSHOT") {
+            uint64_t seq = parseNumber<uint64_t>(nextToken(rest), "snapshot sequence number");
+            uint64_t records = parseNumber<uint64_t>(nextToken(rest), "snapshot record count");
+            uint64_t bytes = parseNumber<uint64_t>(nextToken(rest), "snapshot size");
+            if (bytes > MAX_SNAPSHOT_BYTES || records > bytes / StudentSchema::MIN_BINARY_BYTES) {
+                throw StudentException("snapshot header out of range");
+            }
+            while (buffer.size() - pos < bytes) receive(fd, buffer);
+            resync = true;   // until the new roster is in place
+            sms.installSnapshot(decodeSnapshot(buffer.data() + pos, bytes, records), seq);
+            pos += bytes;
+            resync = false;
+            cout << "Replication: installed a snapshot of " << records << " records at change " << seq << endl;
+        }
+        else if (kind == "STREAM") {
+            if (parseNumber<uint64_t>(nextToken(rest), "sequence number") != sms.journalSeq()) {
+                resync = true;
+                throw StudentException("primary resumed from the wrong change");
+            }
+        }
+        else if (kind == "ERR") {
+            throw StudentException("primary refused: " + string(trimSpaces(rest)));
+        }
+        else {
+            throw StudentException("unexpected reply from primary");
+        }
+        buffer.erase(0, pos);
+        connected = true;
+        cout << "Replication: following " << primaryName << " from change " << sms.journalSeq() << endl;
+
+        vector<JournalEntry> entries;   // decoded, the last commit possibly incomplete
+        size_t groupRemaining = 0;      // Update entries still due in an open transaction
+        size_t pendingBytes = 0;        // size of the incomplete commit
+        for (;;) {
+            size_t complete = 0;
+            for (pos = 0;;) {
+                if (Journal::isHeartbeat(buffer.data() + pos, buffer.size() - pos)) {
+                    pos += Journal::HEARTBEAT_BYTES;
+                    continue;
+                }
+                size_t length = Journal::frameLength(buffer.data() + pos, buffer.size() - pos);
+                if (length > MAX_FRAME_BYTES) throw StudentException("damaged change in replication stream");
+                if (length == 0 || length > buffer.size() - pos) break;
+                JournalEntry e;
+                if (!Journal::decode(buffer.data() + pos, length, e)) {
+                    throw StudentException("damaged change in replication stream");
+                }
+                if (e.op == JournalOp::Begin && e.rollNo > 0) groupRemaining = static_cast<size_t>(e.rollNo);
+                else if (groupRemaining > 0) groupRemaining--;
+                entries.push_back(move(e));
+                pos += length;
+                pendingBytes += length;
+                if (groupRemaining == 0) {
+                    complete = entries.size();
+                    pendingBytes = 0;
+                }
+                // The primary ships only commits its backlog holds
+                else if (pendingBytes > REPLICATION_BACKLOG_BYTES) {
+                    throw StudentException("transaction in replication stream is too large");
+                }
+            }
+            buffer.erase(0, pos);
+            if (complete > 0) {
+                vector<JournalEntry> commits(make_move_iterator(entries.begin()),
+                                             make_move_iterator(entries.begin() + complete));
+                entries.erase(entries.begin(), entries.begin() + complete);
+                try {
+                    sms.applyReplicated(commits);
+                }
+                catch (const StudentException& e) {
+                    resync = true;
+                    throw StudentException(string(e.what()) + "; starting over from a snapshot");
+                }
+            }
+            receive(fd, buffer);
+        }
+    }
+
+    // Follow the primary, reconnecting after any failure, until stop()
+    void run() {
+        // Ctrl+C is for the server thread's epoll_wait
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        string lastError;
+        for (;;) {
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            {
+                lock_guard<mutex> guard(lock);
+                if (stopping) {
+                    if (fd >= 0) close(fd);
+                    return;
+                }
+                socketFd = fd;
+            }
+            string error;
+            try {
+                if (fd < 0) throw StudentException(string("socket failed: ") + strerror(errno));
+                timeval timeout{2, 0};   // bounds connect() and send() as well
+                timeval silence{REPLICATION_TIMEOUT_SECONDS, 0};
+                int one = 1;
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &silence, sizeof(silence));
+                setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                if (connect(fd, reinterpret_cast<const sockaddr*>(&primary), sizeof(primary)) < 0) {
+                    throw StudentException("cannot connect to " + primaryName + ": " + strerror(errno));
+                }
+                lastError.clear();
+                follow(fd);
+            }
+            catch (const exception& e) {
+                error = e.what();
+            }
+            connected = false;
+
+            unique_lock<mutex> guard(lock);
+            if (fd >= 0) close(fd);
+            socketFd = -1;
+            if (stopping) return;
+            if (error != lastError) cout << "Replication: " << error << "; retrying" << endl;
+            lastError = error;
+            if (wake.wait_for(guard, RETRY_INTERVAL, [this] { return stopping; })) return;
+        }
+    }
+
+public:
+    // primaryAddress: <IPv4 address>:<port> of the primary's server
+    Replica(StudentManagementSystem& s, const string& primaryAddress) : sms(s), primaryName(primaryAddress) {
+        size_t colon = primaryAddress.rfind(':');
+        primary.sin_family = AF_INET;
+        if (colon == string::npos || inet_pton(AF_INET, primaryAddress.substr(0, colon).c_str(), &primary.sin_addr) != 1) {
+            throw StudentException("Primary must be given as <IPv4 address>:<port>");
+        }
+        primary.sin_port = htons(parseNumber<uint16_t>(string_view(primaryAddress).substr(colon + 1), "port"));
+    }
+
+    ~Replica() { stop(); }
+
+    // Turn the roster read-only and start following in the background
+    void start() {
+        sms.setReplica(true);
+        worker = thread(&Replica::run, this);
+    }
+
+    // Stop following (the roster stays read-only until setReplica(false))
+    void stop() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+            if (socketFd >= 0) shutdown(socketFd, SHUT_RDWR);
+        }
+        wake.notify_all();
+        if (worker.joinable()) worker.join();
+    }
+
+    const string& primaryAddress() const { return primaryName; }
+    bool isConnected() const { return connected; }
+};
+#endif
+
+// ========== Server Mode ==========
+// Line protocol over TCP, served by one event-driven thread (epoll). A
+// request is any batch-mode command, or QUIT, on its own line; clients may
+// pipeline as many as they like. Each request gets one response, in order:
+//   OK <n>      followed by the n lines of output
+//   ERR <message>
+// Blank lines and '#' comments get no response. Changes are journaled as
+// they arrive and the journal is synced once per event-loop round, before
+// any response of that round goes out, so an OK for a change means it is
+// on disk. Besides the batch commands:
+//   ROLE                   "primary <seq>" or "replica <seq> <primary> <state>"
+//   PROMOTE                stop following and take changes (followers only)
+//   REPLICATE [seq]        turn the connection into a replication stream
+#ifdef SMS_HAVE_EPOLL
+volatile sig_atomic_t serverStopping = 0;
+
+void stopServer(int) { serverStopping = 1; }
+
+class Server {
+private:
+    static const size_t MAX_REQUEST_BYTES = 64 * 1024;
+    static const size_t MAX_PENDING_OUTPUT = 4 * 1024 * 1024;   // stop reading from a client that won't read
+    static const int MAX_EVENTS = 256;
+
+    struct Connection {
+        string input;            // received bytes after the last complete line
+        string output;           // responses not yet sent
+        size_t sent = 0;         // bytes of output already sent
+        uint32_t events = 0;     // epoll interest currently registered
+        bool finished = false;   // peer closed or sent QUIT; close once output drains
+        uint64_t id = 0;         // tells a reused descriptor from the one it replaced
+        bool follower = false;   // sent REPLICATE; gets the change stream
+        bool streaming = false;  // ... and has had its STREAM or SNAPSHOT header
+        bool snapshotPending = false;  // ... or is waiting for the encoder's snapshot
+        uint64_t replicaSeq = 0; // newest change the follower has or was sent
+        shared_ptr<const string> bulk;   // a snapshot, sent ahead of output
+        size_t bulkSent = 0;
+        chrono::steady_clock::time_point lastShipped;
+    };
+
+    // A snapshot encoded for the followers that asked for it (or the error)
+    struct EncodedSnapshot {
+        vector<uint64_t> connections;
+        shared_ptr<const string> data;
+        uint64_t seq = 0;
+        string error;
+    };
+
+    StudentManagementSystem& sms;
+    Replica* replica;         // set when this node is a follower
+    int listenFd = -1;
+    int epollFd = -1;
+    unordered_map<int, Connection> connections;
+    uint64_t lastConnectionId = 0;
+    vector<int> ready;        // connections with output to send this round
+    vector<int> followers;    // connections streaming changes
+    bool needsSync = false;
+
+    // Snapshots for followers starting over are encoded by a thread of
+    // their own, so the event loop never walks the roster. It is handed
+    // each one through `encoded` and woken through wakeFd.
+    thread encoder;
+    mutex encoderLock;        // guards the three fields below
+    condition_variable encoderWake;
+    vector<uint64_t> snapshotRequests;
+    vector<EncodedSnapshot> encoded;
+    bool encoderStopping = false;
+    int wakeFd = -1;
+
+    static size_t pending(const Connection& c) {
+        return (c.bulk ? c.bulk->size() - c.bulkSent : 0) + c.output.size() - c.sent;
+    }
+
+    void respond(int fd, Connection& c, string_view line) {
+        string_view rest = trimSpaces(line);
+        if (rest.empty() || rest[0] == '#') return;
+        string_view verb = nextToken(rest);
+        if (verb == "QUIT") {
+            c.output += "OK 0\n";
+            c.finished = true;
+            return;
+        }
+        try {
+            if (verb == "REPLICATE") {
+                string_view seq = nextToken(rest);
+                c.replicaSeq = seq.empty() ? 0 : parseNumber<uint64_t>(seq, "sequence number");
+                c.follower = true;
+                c.lastShipped = chrono::steady_clock::now();
+                followers.push_back(fd);
+                return;
+            }
+            if (verb == "ROLE") {
+                uint64_t seq = sms.journalSeq();
+                c.output += "OK 1\n";
+                if (replica && sms.isReplica()) {
+                    c.output += "replica " + to_string(seq) + " " + replica->primaryAddress()
+                              + (replica->isConnected() ? " connected\n" : " disconnected\n");
+                }
+                else {
+                    c.output += "primary " + to_string(seq) + "\n";
+                }
+                return;
+            }
+            if (verb == "PROMOTE") {
+                if (!replica || !sms.isReplica()) throw StudentException("This node is already the primary");
+                replica->stop();
+                sms.setReplica(false);
+                c.output += "OK 0\n";
+                return;
+            }
+            ostringstream body;
+            if (isMutatingVerb(runCommand(sms, verb, rest, body))) needsSync = true;
+            string text = body.str();
+            if (!text.empty() && text.back() != '\n') text += '\n';
+            c.output += "OK ";
+            c.output += to_string(count(text.begin(), text.end(), '\n'));
+            c.output += '\n';
+            c.output += text;
+        }
+        catch (const exception& e) {
+            c.output += "ERR ";
+            c.output += e.what();
+            c.output += '\n';
+        }
+    }
+
+    // One recv per readiness event keeps a busy client from starving the
+    // others; level-triggered epoll reports the rest next round
+    void readFrom(int fd, Connection& c) {
+        char buffer[64 * 1024];
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+        if (n <= 0) {
+            // Peer closed (or failed): answer a final unterminated line, then close
+            if (n == 0 && !c.input.empty() && !c.follower) respond(fd, c, c.input);
+            c.input.clear();
+            c.finished = true;
+        }
+        else {
+            c.input.append(buffer, n);
+            size_t begin = 0, newline;
+            while (!c.finished && !c.follower && (newline = c.input.find('\n', begin)) != string::npos) {
+                respond(fd, c, string_view(c.input).substr(begin, newline - begin));
+                begin = newline + 1;
+            }
+            c.input.erase(0, c.finished || c.follower ? c.input.size() : begin);
+            if (c.input.size() > MAX_REQUEST_BYTES) {
+                c.output += "ERR Request too long\n";
+                c.input.clear();
+                c.finished = true;
+            }
+        }
+        ready.push_back(fd);
+    }
+
+    // Send data from `sent` on as far as the socket takes it; false if the peer is gone
+    static bool sendFrom(int fd, const string& data, size_t& sent) {
+        while (sent < data.size()) {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n > 0) {
+                sent += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            return false;
+        }
+        return true;
+    }
+
+    // Send as much pending output as the socket takes; false if the peer is gone
+    bool flush(int fd, Connection& c) {
+        if (c.bulk) {
+            if (!sendFrom(fd, *c.bulk, c.bulkSent)) return false;
+            if (c.bulkSent < c.bulk->size()) return true;
+            c.bulk.reset();
+            c.bulkSent = 0;
+        }
+        if (!sendFrom(fd, c.output, c.sent)) return false;
+        if (c.sent == c.output.size()) {
+            c.output.clear();
+            c.sent = 0;
+        }
+        return true;
+    }
+
+    void watch(int fd, Connection& c) {
+        size_t backlog = pending(c);
+        uint32_t events = 0;
+        if (!c.finished && backlog < MAX_PENDING_OUTPUT) events |= EPOLLIN;
+        if (backlog > 0) events |= EPOLLOUT;
+        if (events == c.events) return;
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+        c.events = events;
+    }
+
+    void drop(int fd) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        if (connections[fd].follower) followers.erase(find(followers.begin(), followers.end(), fd));
+        connections.erase(fd);
+    }
+
+    // Encoder thread: the whole roster as of a snapshot, header included,
+    // for every follower that asked since the last one
+    void encodeSnapshots() {
+        sigset_t signals;   // Ctrl+C is for the event loop's epoll_wait
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        unique_lock<mutex> guard(encoderLock);
+        for (;;) {
+            encoderWake.wait(guard, [this] { return encoderStopping || !snapshotRequests.empty(); });
+            if (encoderStopping) return;
+            EncodedSnapshot result;
+            result.connections.swap(snapshotRequests);
+            guard.unlock();
+            try {
+                RosterSnapshot roster = sms.snapshot();
+                string records;
+                roster.forEach([&](string_view name, int rollNo, float marks) {
+                    StudentSchema::writeBinary(records, StudentSchema::Values(name, rollNo, marks));
+                    return true;
+                });
+                records.insert(0, "SNAPSHOT " + to_string(roster.journalSeq()) + " " + to_string(roster.size()) + " "
+                                  + to_string(records.size()) + "\n");
+                result.data = make_shared<const string>(move(records));
+                result.seq = roster.journalSeq();
+            }
+            catch (const exception& e) {
+                result.error = e.what();
+            }
+            guard.lock();
+            encoded.push_back(move(result));
+            uint64_t one = 1;
+            while (write(wakeFd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+        }
+    }
+
+    void requestSnapshot(Connection& c) {
+        c.snapshotPending = true;
+        {
+            lock_guard<mutex> guard(encoderLock);
+            snapshotRequests.push_back(c.id);
+        }
+        encoderWake.notify_one();
+    }
+
+    // Hand finished snapshots to the followers still waiting for them; the
+    // stream then resumes after the snapshot's change
+    void deliverSnapshots() {
+        uint64_t count;
+        while (read(wakeFd, &count, sizeof(count)) < 0 && errno == EINTR) {}
+        vector<EncodedSnapshot> done;
+        {
+            lock_guard<mutex> guard(encoderLock);
+            done.swap(encoded);
+        }
+        auto now = chrono::steady_clock::now();
+        for (const EncodedSnapshot& snapshot : done) {
+            for (int fd : followers) {
+                Connection& c = connections[fd];
+                if (!c.snapshotPending || find(snapshot.connections.begin(), snapshot.connections.end(), c.id)
+                                          == snapshot.connections.end()) {
+                    continue;
+                }
+                c.snapshotPending = false;
+                if (!snapshot.data) {
+                    c.output += "ERR " + snapshot.error + "\n";
+                    c.finished = true;
+                }
+                else {
+                    // Only blank-line heartbeats can be waiting; the snapshot replaces them
+                    c.output.clear();
+                    c.sent = 0;
+                    c.bulk = snapshot.data;
+                    c.bulkSent = 0;
+                    c.replicaSeq = snapshot.seq;
+                    c.streaming = true;
+                    c.lastShipped = now;
+                }
+                ready.push_back(fd);
+            }
+        }
+    }
+
+    // Send each follower the durable commits it has not had, once it has
+    // read most of what it was sent. One the backlog no longer covers is
+    // sent a snapshot if it is just starting, and is disconnected if it
+    // fell behind mid-stream: it reconnects and starts over. A follower
+    // with nothing to send for a while gets a heartbeat.
+    void shipChanges() {
+        auto now = chrono::steady_clock::now();
+        for (int fd : followers) {
+            Connection& c = connections[fd];
+            if (c.finished || pending(c) >= MAX_PENDING_OUTPUT) continue;
+            size_t before = c.output.size();
+            if (!c.snapshotPending) {
+                uint64_t from = c.replicaSeq;
+                string frames;
+                bool held = (c.streaming || from != 0) && sms.replicationSince(c.replicaSeq, frames, MAX_PENDING_OUTPUT);
+                if (!c.streaming && !held) {
+                    requestSnapshot(c);
+                }
+                else {
+                    if (!c.streaming) c.output += "STREAM " + to_string(from) + "\n";
+                    c.streaming = true;
+                    if (held) c.output += frames;
+                    else c.finished = true;
+                }
+            }
+            if (c.output.size() != before) {
+                c.lastShipped = now;
+            }
+            else if (!c.finished && now - c.lastShipped >= chrono::milliseconds(REPLICATION_HEARTBEAT_MS)) {
+                if (c.streaming) c.output.append(Journal::HEARTBEAT_BYTES, '\0');
+                else c.output += '\n';
+                c.lastShipped = now;
+            }
+            if (c.output.size() != before || c.finished) ready.push_back(fd);
+        }
+    }
+
+    void acceptClients() {
+        for (;;) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                return;   // drained the backlog (or out of descriptors; retried next round)
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                close(fd);
+                continue;
+            }
+            connections[fd].events = EPOLLIN;
+            connections[fd].id = ++lastConnectionId;
+        }
+    }
+
+public:
+    explicit Server(StudentManagementSystem& s, Replica* follower = nullptr) : sms(s), replica(follower) {}
+
+    ~Server() {
+        {
+            lock_guard<mutex> guard(encoderLock);
+            encoderStopping = true;
+        }
+        encoderWake.notify_all();
+        if (encoder.joinable()) encoder.join();
+        for (auto& entry : connections) close(entry.first);
+        if (listenFd >= 0) close(listenFd);
+        if (epollFd >= 0) close(epollFd);
+        if (wakeFd >= 0) close(wakeFd);
+    }
+
+    // Bind and listen; returns the port actually bound (useful with port 0)
+    uint16_t start(const string& address, uint16_t port) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+            throw StudentException("Invalid listen address " + address);
+        }
+
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        if (listenFd < 0 || setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0
+            || bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+            || listen(listenFd, SOMAXCONN) < 0) {
+            throw StudentException("Cannot listen on " + address + ":" + to_string(port) + ": " + strerror(errno));
+        }
+        socklen_t length = sizeof(addr);
+        getsockname(listenFd, reinterpret_cast<sockaddr*>(&addr), &length);
+
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = listenFd;
+        epoll_event wake{};
+        wake.events = EPOLLIN;
+        wake.data.fd = wakeFd;
+        if (epollFd < 0 || wakeFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev) < 0
+            || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wake) < 0) {
+            throw StudentException(string("epoll setup failed: ") + strerror(errno));
+        }
+        encoder = thread(&Server::encodeSnapshots, this);
+        return ntohs(addr.sin_port);
+    }
+
+    // Serve until SIGINT/SIGTERM
+    void run() {
+        epoll_event events[MAX_EVENTS];
+        while (!serverStopping) {
+            // Followers are due heartbeats even when nothing happens
+            int n = epoll_wait(epollFd, events, MAX_EVENTS, followers.empty() ? -1 : REPLICATION_HEARTBEAT_MS);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw StudentException(string("epoll_wait failed: ") + strerror(errno));
+            }
+
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == listenFd) {
+                    acceptClients();
+                    continue;
+                }
+                if (fd == wakeFd) {
+                    deliverSnapshots();
+                    continue;
+                }
+                auto it = connections.find(fd);
+                if (it == connections.end()) continue;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) readFrom(fd, it->second);
+                if (events[i].events & EPOLLOUT) ready.push_back(fd);
+            }
+
+            // Group commit: one fsync covers every change made this round,
+            // and followers are sent changes only once they are durable
+            if (needsSync) {
+                sms.sync();
+                needsSync = false;
+            }
+            shipChanges();
+
+            for (int fd : ready) {
+                auto it = connections.find(fd);
+                if (it == connections.end()) continue;
+                Connection& c = it->second;
+                if (!flush(fd, c) || (c.finished && pending(c) == 0)) drop(fd);
+                else watch(fd, c);
+            }
+            ready.clear();
+        }
+    }
+};
+#endif
+
+// ========== Benchmarks ==========
+// Benchmarks run inside a fresh temporary directory, so the real
+// students.dat and journal are never touched; it is removed afterwards
+class ScratchDirectory {
+private:
+    filesystem::path home;
+    filesystem::path path;
+
+public:
+    explicit ScratchDirectory(const string& prefix = "sms-bench-")
+        : home(filesystem::current_path()),
+          path(filesystem::temp_directory_path()
+               / (prefix + to_string(chrono::steady_clock::now().time_since_epoch().count()))) {
+        filesystem::create_directories(path);
+        filesystem::current_path(path);
+    }
+
+    ~ScratchDirectory() {
+        error_code ignored;
+        filesystem::current_path(home, ignored);
+        filesystem::remove_all(path, ignored);
+    }
+};
+
+// Silences cout (load/save chatter) while in scope
+class QuietConsole {
+private:
+    streambuf* console;
+
+public:
+    QuietConsole() : console(cout.rdbuf(nullptr)) {}
+    ~QuietConsole() { cout.rdbuf(console); }
+};
+
+// Stream buffer that discards everything, for timing output paths
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+    streamsize xsputn(const char*, streamsize n) override { return n; }
+};
+
+// Time a lambda over `repeats` runs and return the best run in milliseconds
+template <typename F>
+double bestOfMillis(int repeats, F&& f) {
+    double best = numeric_limits<double>::max();
+    for (int r = 0; r < repeats; r++) {
+        auto start = chrono::steady_clock::now();
+        f();
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+    return best;
+}
+
+// Compare the original showStatistics loop (float accumulator, three
+// getMarks() calls per Student) with the aggregation kernels
+void runStatisticsBenchmark(size_t rows) {
+    mt19937 rng(42);
+    uniform_real_distribution<float> dist(0.0f, 100.0f);
+    vector<Student> records;
+    vector<float> column;
+    records.reserve(rows);
+    column.reserve(rows);
+    for (size_t i = 0; i < rows; i++) {
+        float m = dist(rng);
+        records.push_back(Student("Student", static_cast<int>(i), m));
+        column.push_back(m);
+    }
+
+    // Reference value with long double accumulation
+    long double exact = 0;
+    for (float m : column) exact += m;
+
+    float legacyTotal = 0, legacyMax = 0, legacyMin = 0;
+    double legacyMs = bestOfMillis(5, [&] {
+        float total = 0, maxMarks = records[0].getMarks(), minMarks = records[0].getMarks();
+        for (const Student& s : records) {
+            total += s.getMarks();
+            if (s.getMarks() > maxMarks) maxMarks = s.getMarks();
+            if (s.getMarks() < minMarks) minMarks = s.getMarks();
+        }
+        legacyTotal = total;
+        legacyMax = maxMarks;
+        legacyMin = minMarks;
+    });
+
+    MarksSummary scalar, dispatched;
+    double scalarMs = bestOfMillis(5, [&] { scalar = summarizeMarksScalar(column.data(), rows); });
+    const char* kernelName = "scalar";
+    SummarizeKernel kernel = selectSummarizeKernel(&kernelName);
+    double kernelMs = bestOfMillis(5, [&] { dispatched = kernel(column.data(), rows); });
+
+    cout << "Statistics benchmark, " << rows << " rows (best of 5)" << endl;
+    cout << fixed << setprecision(3);
+    cout << "  legacy loop : " << setw(10) << legacyMs << " ms   sum error " << fabs(double(legacyTotal - exact))
+         << "   range " << legacyMin << "-" << legacyMax << endl;
+    cout << "  scalar      : " << setw(10) << scalarMs << " ms   sum error " << fabs(double(scalar.sum - exact)) << endl;
+    cout << "  " << left << setw(12) << kernelName << right << ": " << setw(10) << kernelMs
+         << " ms   sum error " << fabs(double(dispatched.sum - exact)) << endl;
+}
+
+// True when both stdin and stdout are attached to a terminal
+bool interactiveTerminal() {
+#ifdef SMS_HAVE_ISATTY
+    return isatty(STDIN_FILENO) && isatty(STDOUT_FILENO);
+#else
+    return false;
+#endif
+}
+
+// Drop the rest of the current input line (e.g. after reading a menu choice)
+void clearLine() {
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+}
+
+// Names shaped like a real roster: "First Last", 3-24 bytes
+vector<string> syntheticNames(size_t rows, uint32_t seed = 42) {
+    static const char* const first[] = {"Ali", "Sara", "Usman", "Ayesha", "Muhammad", "Fatima", "Bilal",
+                                         "Zainab", "Hamza", "Maryam", "Omar", "Hina", "Abdullah", "Iqra"};
+    static const char* const last[] = {"Khan", "Ahmed", "Malik", "Butt", "Chaudhry", "Siddiqui", "Qureshi",
+                                       "Sheikh", "Raza", "Iqbal", "Hussain", "Mirza"};
+    mt19937 rng(seed);
+    vector<string> names;
+    names.reserve(rows);
+    for (size_t i = 0; i < rows; i++) {
+        string name = first[rng() % 14];
+        if (rng() % 4 != 0) name += string(" ") + last[rng() % 12];   // a quarter are single names
+        names.push_back(move(name));
+    }
+    return names;
+}
+
+// Compare name storage: one std::string per Student (the original layout)
+// against the store's inline slots + arena, on the default heap and on a
+// pmr::monotonic_buffer_resource
+void runNameStorageBenchmark(size_t rows) {
+    vector<string> names = syntheticNames(rows);
+    const size_t SSO = string().capacity();
+
+    size_t legacyBytes = 0;
+    double legacyMs = bestOfMillis(3, [&] {
+        vector<Student> records;
+        for (size_t i = 0; i < rows; i++) records.push_back(Student(names[i], static_cast<int>(i), 50.0f));
+        legacyBytes = records.capacity() * sizeof(Student);
+        for (const Student& st : records) {
+            if (st.getName().capacity() > SSO) legacyBytes += st.getName().capacity() + 1;
+        }
+    });
+
+    size_t storeBytes = 0, inlineNames = 0;
+    double storeMs = bestOfMillis(3, [&] {
+        StudentStore store;
+        for (size_t i = 0; i < rows; i++) store.emplace_back(names[i], static_cast<int>(i), 50.0f);
+        storeBytes = store.memoryUsage();
+    });
+    for (const string& n : names) inlineNames += n.size() <= StudentStore::INLINE_NAME_BYTES;
+
+    double pmrMs = bestOfMillis(3, [&] {
+        pmr::monotonic_buffer_resource pool;
+        StudentStore store(&pool);
+        for (size_t i = 0; i < rows; i++) store.emplace_back(names[i], static_cast<int>(i), 50.0f);
+    });
+
+    cout << "Name storage benchmark, " << rows << " rows (best of 3, "
+         << (100.0 * inlineNames / max<size_t>(rows, 1)) << "% of names inline)" << endl;
+    cout << fixed << setprecision(3);
+    cout << "  vector<Student>      : " << setw(10) << legacyMs << " ms  " << setw(10) << legacyBytes / 1048576.0 << " MiB" << endl;
+    cout << "  StudentStore (heap)  : " << setw(10) << storeMs << " ms  " << setw(10) << storeBytes / 1048576.0 << " MiB" << endl;
+    cout << "  StudentStore (pmr)   : " << setw(10) << pmrMs << " ms" << endl;
+}
+
+// Compare the Student stream operators (the original codec) with the
+// schema-generated text and binary codecs, each writing `rows` records
+// to a scratch file and reading them back into Students
+void runCodecBenchmark(size_t rows) {
+    vector<string> names = syntheticNames(rows);
+    vector<Student> records;
+    records.reserve(rows);
+    mt19937 rng(7);
+    uniform_int_distribution<int> hundredths(0, 10000);
+    for (size_t i = 0; i < rows; i++) records.emplace_back(names[i], static_cast<int>(i), hundredths(rng) / 100.0f);
+    string path = (filesystem::temp_directory_path() / "sms_codec_bench.tmp").string();
+    size_t readBack = 0;
+
+    // Each write goes to a new file: truncating the last run's file can
+    // make the filesystem flush it first, which would swamp the timings
+    double streamWriteMs = bestOfMillis(3, [&] {
+        filesystem::remove(path);
+        ofstream out(path);
+        for (const Student& s : records) out << s;
+    });
+    double streamReadMs = bestOfMillis(3, [&] {
+        ifstream in(path);
+        Student s;
+        for (readBack = 0; readBack < rows && in >> s; readBack++) {}
+    });
+
+    // The schema codecs encode into a buffer written with one call, and
+    // decode from the mapped file
+    auto timeCodec = [&](bool binary, double& writeMs, double& readMs) {
+        string buffer;
+        writeMs = bestOfMillis(3, [&] {
+            buffer.clear();
+            for (const Student& s : records) {
+                if (binary) StudentSchema::writeBinary(buffer, StudentSchema::values(s));
+                else StudentSchema::writeText(buffer, StudentSchema::values(s));
+            }
+            filesystem::remove(path);
+            ofstream out(path, ios::binary);
+            out.write(buffer.data(), buffer.size());
+        });
+        size_t matched = 0;
+        readMs = bestOfMillis(3, [&] {
+            MappedFile file;
+            if (!file.open(path)) throw StudentException("Cannot read " + path);
+            const char* p = file.data();
+            const char* end = p + file.size();
+            StudentSchema::Values v;
+            matched = 0;
+            for (size_t i = 0; i < rows; i++) {
+                if (binary) {
+                    if (!StudentSchema::readBinary(p, end, v)) throw StudentException("Corrupted data in file");
+                }
+                else {
+                    p = StudentSchema::readText(p, end, v);
+                }
+                StudentSchema::check(v);
+                Student s = StudentSchema::toStudent(v);
+                matched += s.getName() == records[i].getName() && s.getRollNo() == records[i].getRollNo()
+                        && s.getMarks() == records[i].getMarks();
+            }
+        });
+        if (matched != rows) throw StudentException("Codec round trip changed " + to_string(rows - matched) + " records");
+    };
+    if (readBack != rows) throw StudentException("operator>> read back " + to_string(readBack) + " records");
+    double textWriteMs, textReadMs, binaryWriteMs, binaryReadMs;
+    timeCodec(false, textWriteMs, textReadMs);
+    timeCodec(true, binaryWriteMs, binaryReadMs);
+    filesystem::remove(path);
+
+    cout << "Record codec benchmark, " << rows << " rows (best of 3)" << endl;
+    cout << fixed << setprecision(3);
+    cout << "                        write ms     read ms" << endl;
+    cout << "  operator<< / >>    : " << setw(10) << streamWriteMs << "  " << setw(10) << streamReadMs << endl;
+    cout << "  schema text codec  : " << setw(10) << textWriteMs << "  " << setw(10) << textReadMs << endl;
+    cout << "  schema binary codec: " << setw(10) << binaryWriteMs << "  " << setw(10) << binaryReadMs << endl;
+}
+
+// Stress test for concurrent access: `threads` workers share one roster
+// and mix reads (lookups, range counts, statistics) with updates, for a
+// range of read shares. It runs in a scratch directory, so the real
+// students.dat is never touched, and the journal syncs only at the end,
+// so the numbers measure locking rather than the disk.
+void runConcurrencyBenchmark(size_t rows, unsigned threads) {
+    const size_t OPS_PER_THREAD = 100000;
+    const int READ_PERCENTS[] = {100, 99, 90, 50, 0};
+
+    ScratchDirectory scratch;
+    vector<string> names = syntheticNames(rows);
+    unique_ptr<StudentManagementSystem> sms;
+    {
+        QuietConsole quiet;
+        sms = make_unique<StudentManagementSystem>();
+    }
+    sms->setDeferredSync(true);
+
+    mt19937 rng(7);
+    uniform_real_distribution<float> marksDist(0.0f, 100.0f);
+    for (size_t i = 0; i < rows; i++) sms->addRecord(names[i], static_cast<int>(i), marksDist(rng));
+    // Build the lazy indexes up front so every run starts from the same state
+    sms->lookup(0);
+    sms->countMarksRange(0, 100);
+    sms->statistics();
+
+    cout << "Concurrency benchmark, " << rows << " rows, " << threads << " threads x "
+         << OPS_PER_THREAD << " ops" << endl;
+    for (int readPercent : READ_PERCENTS) {
+        atomic<size_t> checksum{0};
+        auto start = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (unsigned t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                mt19937 local(100 + t);
+                uniform_real_distribution<float> marks(0.0f, 100.0f);
+                size_t seen = 0;
+                for (size_t op = 0; op < OPS_PER_THREAD; op++) {
+                    int rollNo = static_cast<int>(local() % rows);
+                    if (static_cast<int>(local() % 100) >= readPercent) {
+                        sms->updateRecordByRoll(rollNo, names[rollNo], marks(local));
+                        continue;
+                    }
+                    switch (local() % 3) {
+                        case 0: seen += sms->lookup(rollNo).has_value(); break;
+                        case 1: {
+                            float lo = marks(local);
+                            seen += sms->countMarksRange(lo, lo + 1.0f);
+                            break;
+                        }
+                        default: seen += sms->statistics().count; break;
+                    }
+                }
+                checksum += seen;
+            });
+        }
+        for (thread& w : workers) w.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "  " << setw(3) << readPercent << "% reads: " << fixed << setprecision(0)
+             << setw(12) << threads * OPS_PER_THREAD / seconds << " ops/sec" << endl;
+    }
+
+    sms->sync();
+    QuietConsole quiet;
+    sms.reset();
+}
+
+struct BenchResult {
+    const char* operation;
+    size_t rows;
+    size_t ops;
+    double totalMs;
+};
+
+// Whole-system benchmark: for each roster size up to maxRows, time every
+// operation through the public API (saves through writeSnapshot). A table
+// goes to stderr and a JSON report to stdout, for tracking across builds:
+//   StudentManagementSystem --bench-suite 10000000 > bench.json
+void runBenchmarkSuite(size_t maxRows) {
+    const size_t SIZES[] = {1000, 10000, 100000, 1000000, 10000000, 50000000};
+    const size_t MAX_OPS = 1000000;   // per-record operations are sampled above this
+    const size_t STAT_CALLS = 1000;
+    vector<BenchResult> results;
+    NullBuffer discard;
+    ostream sink(&discard);
+
+    for (size_t rows : SIZES) {
+        if (rows > maxRows) break;
+        ScratchDirectory scratch;
+        vector<string> names = syntheticNames(rows);
+        vector<float> marks(rows);
+        mt19937 rng(static_cast<uint32_t>(rows));
+        uniform_real_distribution<float> dist(0.0f, 100.0f);
+        for (float& m : marks) m = dist(rng);
+        size_t ops = min(rows, MAX_OPS);
+        vector<int> probes(ops);
+        for (int& p : probes) p = static_cast<int>(rng() % rows);
+        size_t checksum = 0;
+
+        auto timed = [&](const char* operation, size_t count, auto&& body) {
+            auto start = chrono::steady_clock::now();
+            body();
+            chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+            results.push_back(BenchResult{operation, rows, count, elapsed.count()});
+        };
+
+        unique_ptr<StudentManagementSystem> sms;
+        {
+            QuietConsole quiet;
+            sms = make_unique<StudentManagementSystem>();
+        }
+        sms->setDeferredSync(true);
+        timed("add", rows, [&] {
+            for (size_t i = 0; i < rows; i++) sms->addRecord(names[i], static_cast<int>(i), marks[i]);
+            sms->sync();
+        });
+        timed("search", ops, [&] {
+            for (int rollNo : probes) checksum += sms->lookup(rollNo).has_value();
+        });
+        timed("update", ops, [&] {
+            for (int rollNo : probes) sms->updateRecordByRoll(rollNo, names[rollNo], 100.0f - marks[rollNo]);
+            sms->sync();
+        });
+        timed("statistics_first", 1, [&] { checksum += sms->statistics().count; });
+        timed("statistics", STAT_CALLS, [&] {
+            for (size_t i = 0; i < STAT_CALLS; i++) checksum += sms->statistics().count;
+        });
+        timed("percentiles", STAT_CALLS, [&] {
+            for (size_t i = 0; i < STAT_CALLS; i++) checksum += sms->marksPercentiles({25, 50, 75}).size();
+        });
+        timed("display", rows, [&] { sms->displayAll(TableFormat::CSV, 0, sink); });
+        timed("sorted_first", rows, [&] { sms->displayAll(TableFormat::CSV, 0, sink, SortKey::Name); });
+        timed("sorted", rows, [&] { sms->displayAll(TableFormat::CSV, 0, sink, SortKey::Name); });
+        timed("delete", ops, [&] {
+            // 7919 is prime and no size divides by it, so the rolls are distinct
+            for (size_t i = 0; i < ops; i++) sms->deleteRecord(static_cast<int>(i * 7919 % rows));
+            sms->sync();
+        });
+        {
+            QuietConsole quiet;
+            sms.reset();
+        }
+
+        StudentStore store;
+        store.reserve(rows);
+        for (size_t i = 0; i < rows; i++) store.emplace_back(names[i], static_cast<int>(i), marks[i]);
+        timed("save", rows, [&] { writeSnapshot(store, 0); });
+        filesystem::remove(JOURNAL_FILE);
+        filesystem::remove(OLD_JOURNAL_FILE);
+        timed("load", rows, [&] {
+            QuietConsole quiet;
+            sms = make_unique<StudentManagementSystem>();
+            checksum += sms->lookup(0).has_value();   // includes building the roll index
+        });
+        {
+            QuietConsole quiet;
+            sms.reset();
+        }
+        timed("save_compressed", rows, [&] { writePackedSnapshot(store, 0); });
+        timed("load_compressed", rows, [&] {
+            QuietConsole quiet;
+            sms = make_unique<StudentManagementSystem>();
+            checksum += sms->lookup(0).has_value();   // first query decodes one block
+        });
+        {
+            QuietConsole quiet;
+            sms.reset();
+        }
+        if (checksum == 0) cerr << "(empty benchmark run)" << endl;
+    }
+
+    cerr << left << setw(18) << "operation" << right << setw(10) << "rows" << setw(10) << "ops"
+         << setw(14) << "total ms" << setw(14) << "ns/op" << endl;
+    for (const BenchResult& r : results) {
+        cerr << left << setw(18) << r.operation << right << setw(10) << r.rows << setw(10) << r.ops
+             << fixed << setprecision(3) << setw(14) << r.totalMs
+             << setprecision(1) << setw(14) << r.totalMs * 1e6 / r.ops << endl;
+    }
+
+    const char* kernelName = "scalar";
+    selectSummarizeKernel(&kernelName);
+    cout << "{\n  \"suite\": \"StudentManagementSystem\",\n  \"compiler\": \"" << __VERSION__
+         << "\",\n  \"statistics_kernel\": \"" << kernelName << "\",\n  \"threads\": " << workerCount()
+         << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        cout << (i ? "," : "") << "\n    {\"operation\": \"" << r.operation << "\", \"rows\": " << r.rows
+             << ", \"ops\": " << r.ops << ", \"total_ms\": " << fixed << setprecision(3) << r.totalMs
+             << ", \"ns_per_op\": " << setprecision(1) << r.totalMs * 1e6 / r.ops << "}";
+    }
+    cout << "\n  ]\n}" << endl;
+}
+
+// ========== Self-Test ==========
+// StudentManagementSystem --self-test: checks the parts that can break
+// without any visible symptom, each in a scratch directory of its own.
+// It exits non-zero if any check fails, so a build can run it as its test
+// step. Build it with -fsanitize=thread as well to check the locking.
+using RosterContents = map<int, pair<string, float>>;
+
+void expect(bool ok, const string& what) {
+    if (!ok) throw StudentException(what);
+}
+
+RosterContents contentsOf(const RosterSnapshot& snapshot) {
+    RosterContents contents;
+    snapshot.forEach([&](string_view name, int rollNo, float marks) {
+        contents[rollNo] = {string(name), marks};
+        return true;
+    });
+    expect(contents.size() == snapshot.size(), "snapshot size differs from its records");
+    return contents;
+}
+
+// What a crash at this point would leave behind: a copy of students.dat
+// and of the first journalBytes of the (synced) journal, opened afresh
+RosterContents recoverCrashImage(uint64_t journalBytes) {
+    filesystem::path image = "crash-image";
+    filesystem::remove_all(image);
+    filesystem::create_directory(image);
+    if (filesystem::exists(DATA_FILE)) filesystem::copy_file(DATA_FILE, image / DATA_FILE);
+    filesystem::copy_file(JOURNAL_FILE, image / JOURNAL_FILE);
+    filesystem::resize_file(image / JOURNAL_FILE, journalBytes);
+    filesystem::current_path(image);
+    RosterContents recovered;
+    try {
+        StudentManagementSystem sms;
+        recovered = contentsOf(sms.snapshot());
+    }
+    catch (...) {
+        filesystem::current_path("..");
+        throw;
+    }
+    filesystem::current_path("..");
+    return recovered;
+}
+
+// Writers on disjoint roll numbers against readers that check every record
+// they see is whole: a name always spells its roll number and marks
+void selfTestConcurrency() {
+    const int WRITERS = 4, READERS = 4, OPS = 4000;
+    auto nameFor = [](int rollNo, float marks) { return "s" + to_string(rollNo) + "-" + to_string(int(marks)); };
+    auto whole = [&](string_view name, int rollNo, float marks) { return name == nameFor(rollNo, marks); };
+
+    StudentManagementSystem sms;
+    vector<map<int, float>> models(WRITERS);
+    atomic<int> running{WRITERS};
+    mutex failureLock;
+    string failure;
+    auto fail = [&](const string& what) {
+        lock_guard<mutex> guard(failureLock);
+        if (failure.empty()) failure = what;
+    };
+
+    vector<thread> threads;
+    for (int w = 0; w < WRITERS; w++) {
+        threads.emplace_back([&, w] {
+            try {
+                map<int, float>& model = models[w];
+                int base = (w + 1) * 1000000;
+                for (int i = 0; i < OPS; i++) {
+                    int rollNo = base + i;
+                    float marks = float((i * 7 + w) % 101);
+                    sms.addRecord(nameFor(rollNo, marks), rollNo, marks);
+                    model[rollNo] = marks;
+                    if (i % 3 == 2) {
+                        int target = base + i / 2;
+                        if (model.count(target)) {
+                            float m = float((i + 13) % 101);
+                            sms.updateRecordByRoll(target, nameFor(target, m), m);
+                            model[target] = m;
+                        }
+                    }
+                    if (i % 5 == 4) {
+                        int target = base + i - 4;
+                        if (model.count(target)) {
+                            sms.deleteRecord(target);
+                            model.erase(target);
+                        }
+                    }
+                    if (i % 50 == 49) {
+                        vector<RecordChange> changes;
+                        for (int k = i - 40; k < i - 30; k++) {
+                            if (!model.count(base + k)) continue;
+                            float m = float((k + i) % 101);
+                            changes.push_back(RecordChange{base + k, nameFor(base + k, m), m});
+                            model[base + k] = m;
+                        }
+                        sms.updateRecords(changes);
+                    }
+                }
+            }
+            catch (const exception& e) {
+                fail(string("writer: ") + e.what());
+            }
+            running--;
+        });
+    }
+    for (int r = 0; r < READERS; r++) {
+        threads.emplace_back([&, r] {
+            try {
+                mt19937 random(r);
+                for (size_t round = 0; running > 0; round++) {
+                    int rollNo = int((random() % WRITERS + 1) * 1000000 + random() % OPS);
+                    optional<Student> s = sms.lookup(rollNo);
+                    if (s && !whole(s->getName(), rollNo, s->getMarks())) fail("lookup saw a torn record for " + to_string(rollNo));
+                    if (round % 64 == 0) {
+                        RosterSnapshot snapshot = sms.snapshot(round % 128 == 0 ? SortKey::Marks : SortKey::Insertion);
+                        size_t seen = 0;
+                        snapshot.forEach([&](string_view name, int roll, float marks) {
+                            if (!whole(name, roll, marks)) fail("snapshot saw a torn record for " + to_string(roll));
+                            seen++;
+                            return true;
+                        });
+                        if (seen != snapshot.size()) fail("snapshot size differs from its records");
+                        MarksReport report = sms.marksReport({0, 100});
+                        if (report.summary.count > 0 && (report.percentiles[0] != report.summary.minMarks
+                                                         || report.percentiles[1] != report.summary.maxMarks)) {
+                            fail("statistics and percentiles disagree");
+                        }
+                    }
+                }
+            }
+            catch (const exception& e) {
+                fail(string("reader: ") + e.what());
+            }
+        });
+    }
+    for (thread& t : threads) t.join();
+    expect(failure.empty(), failure);
+
+    RosterContents expected;
+    for (const map<int, float>& model : models) {
+        for (const auto& [rollNo, marks] : model) expected[rollNo] = {nameFor(rollNo, marks), marks};
+    }
+    expect(contentsOf(sms.snapshot()) == expected, "roster differs from what the writers did");
+    expect(sms.statistics().count == expected.size(), "running statistics miscounted");
+    expect(sms.countMarksRange(0, 100) == expected.size(), "marks index miscounted");
+}
+
+// Every change is journaled: a crash image recovers all of them, on top
+// of a saved data file or without one
+void selfTestJournalReplay() {
+    RosterContents model;
+    {
+        StudentManagementSystem sms;
+        for (int i = 1; i <= 300; i++) {
+            sms.addRecord("first " + to_string(i), i, float(i % 100));
+            model[i] = {"first " + to_string(i), float(i % 100)};
+        }
+    }   // saved on exit
     StudentManagementSystem sms;
-    int choice;
+    for (int i = 301; i <= 400; i++) {
+        sms.addRecord("second " + to_string(i), i, 50.5f);
+        model[i] = {"second " + to_string(i), 50.5f};
+    }
+    for (int i = 1; i <= 400; i += 7) {
+        sms.updateRecordByRoll(i, "renamed " + to_string(i), 99.25f);
+        model[i] = {"renamed " + to_string(i), 99.25f};
+    }
+    for (int i = 2; i <= 400; i += 11) {
+        sms.deleteRecord(i);
+        model.erase(i);
+    }
+    sms.sync();
+    expect(recoverCrashImage(filesystem::file_size(JOURNAL_FILE)) == model, "journal replay lost changes");
+}
+
+// A transaction cut off by a crash is dropped whole, wherever it was cut
+void selfTestTornTransaction() {
+    StudentManagementSystem sms;
+    RosterContents before;
+    for (int i = 1; i <= 50; i++) {
+        sms.addRecord("student " + to_string(i), i, 40);
+        before[i] = {"student " + to_string(i), 40.0f};
+    }
+    sms.sync();
+    uint64_t committed = filesystem::file_size(JOURNAL_FILE);
+
+    vector<RecordChange> changes;
+    RosterContents after = before;
+    for (int i = 10; i < 20; i++) {
+        changes.push_back(RecordChange{i, "graded " + to_string(i), 90.0f});
+        after[i] = {"graded " + to_string(i), 90.0f};
+    }
+    sms.updateRecords(changes);
+    sms.sync();
+    uint64_t end = filesystem::file_size(JOURNAL_FILE);
+
+    for (uint64_t cut : {committed + 1, committed + (end - committed) / 2, end - 1}) {
+        expect(recoverCrashImage(cut) == before, "a torn transaction was partly applied (cut at byte " + to_string(cut) + ")");
+    }
+    expect(recoverCrashImage(end) == after, "a complete transaction was not applied");
+}
+
+// Percentiles and bands against a brute-force count over the same marks,
+// grid and off-grid, after adds, updates and deletes
+void selfTestHistogram() {
+    StudentManagementSystem sms;
+    const vector<double> ps = {0, 1, 10, 25, 50, 75, 90, 99, 100};
+    MarksReport empty = sms.marksReport(ps);
+    expect(empty.summary.count == 0 && all_of(empty.percentiles.begin(), empty.percentiles.end(), [](double v) { return v == 0; }),
+           "an empty roster has non-zero percentiles");
+
+    mt19937 random(7);
+    map<int, float> model;
+    for (int i = 1; i <= 3000; i++) {
+        float marks;
+        switch (i % 5) {
+            case 0: marks = float(random() % 101); break;                          // whole marks
+            case 1: marks = float(random() % 10001) / 100.0f; break;               // on the grid
+            case 2: marks = nextafter(float(random() % 10 + 1) * 10.0f, 0.0f); break;   // just under a band
+            case 3: marks = float(random() % 1000000) / 10000.0f; break;           // off the grid
+            default: marks = i % 2 ? 0.0f : 100.0f; break;
+        }
+        sms.addRecord("h" + to_string(i), i, marks);
+        model[i] = marks;
+    }
+    for (int i = 1; i <= 3000; i += 9) {
+        float marks = float(random() % 1000000) / 10000.0f;
+        sms.updateRecordByRoll(i, "h" + to_string(i), marks);
+        model[i] = marks;
+    }
+    for (int i = 4; i <= 3000; i += 13) {
+        sms.deleteRecord(i);
+        model.erase(i);
+    }
+
+    vector<float> sorted;
+    for (const auto& entry : model) sorted.push_back(entry.second);
+    sort(sorted.begin(), sorted.end());
+    MarksReport report = sms.marksReport(ps);
+    expect(report.summary.count == sorted.size(), "statistics miscounted");
+    for (size_t i = 0; i < ps.size(); i++) {
+        double rank = ps[i] / 100.0 * double(sorted.size() - 1);
+        size_t k = static_cast<size_t>(rank);
+        double frac = rank - double(k);
+        double expected = frac > 0 ? sorted[k] + frac * (double(sorted[k + 1]) - sorted[k]) : sorted[k];
+        expect(report.percentiles[i] == expected, "p" + to_string(ps[i]) + " is " + to_string(report.percentiles[i])
+                                                  + ", expected " + to_string(expected));
+    }
+
+    for (float width : {10.0f, 7.5f, 33.0f, 0.01f, 100.0f}) {
+        size_t step = static_cast<size_t>(lround(double(width) * 100.0));
+        size_t bandCount = (10000 + step - 1) / step;
+        auto boundary = [&](size_t band) { return static_cast<float>(band * step) / 100.0f; };
+        vector<uint64_t> expected(bandCount);
+        for (float m : sorted) {
+            size_t band = min(bandCount - 1, static_cast<size_t>(m * 100.0f) / step);
+            while (band + 1 < bandCount && boundary(band + 1) <= m) band++;
+            while (band > 0 && boundary(band) > m) band--;
+            expected[band]++;
+        }
+        expect(sms.marksHistogram(width) == expected, "bands of width " + to_string(width) + " miscounted");
+    }
+}
+
+// A snapshot never changes once taken, and a new one shows every change,
+// both for a roster still served from its mapped file and after writes
+void selfTestSnapshots() {
+    {
+        StudentManagementSystem sms;
+        for (int i = 1; i <= 10000; i++) sms.addRecord("n" + to_string(i % 977) + "-" + to_string(i), i, float(i % 101));
+    }
+    StudentManagementSystem sms;   // mapped view of the saved file
+    RosterSnapshot insertion = sms.snapshot(), byName = sms.snapshot(SortKey::Name);
+    RosterContents original = contentsOf(insertion);
+    expect(original.size() == 10000, "snapshot of the mapped roster is incomplete");
+    auto names = [](const RosterSnapshot& s) {
+        vector<string> out;
+        s.forEach([&](string_view name, int, float) {
+            out.emplace_back(name);
+            return true;
+        });
+        return out;
+    };
+    vector<string> originalOrder = names(byName);
+    expect(is_sorted(originalOrder.begin(), originalOrder.end()), "name order is not sorted");
+
+    RosterContents model = original;
+    auto change = [&](int rounds) {
+        for (int i = 1; i <= rounds; i++) {
+            int rollNo = i * 37 % 10000 + 1;
+            if (!model.count(rollNo)) continue;
+            if (i % 2) {
+                sms.updateRecordByRoll(rollNo, "a" + to_string(i), 12.5f);
+                model[rollNo] = {"a" + to_string(i), 12.5f};
+            }
+            else {
+                sms.deleteRecord(rollNo);
+                model.erase(rollNo);
+            }
+        }
+        sms.addRecord("added", 20000 + rounds, 1);
+        model[20000 + rounds] = {"added", 1.0f};
+    };
+
+    change(10);
+    expect(contentsOf(insertion) == original && names(byName) == originalOrder, "a change showed through an older snapshot");
+    RosterSnapshot second = sms.snapshot();
+    expect(contentsOf(second) == model, "a new snapshot missed a change");
+    vector<string> order = names(sms.snapshot(SortKey::Name));
+    expect(is_sorted(order.begin(), order.end()) && order.size() == model.size(), "name order is stale");
+
+    RosterContents secondContents = model;
+    change(6000);   // enough deletes to compact the store
+    expect(contentsOf(second) == secondContents, "compaction showed through an older snapshot");
+    expect(contentsOf(sms.snapshot()) == model && contentsOf(sms.snapshot(SortKey::Marks)) == model,
+           "a snapshot after compaction is wrong");
+    expect(contentsOf(insertion) == original, "the first snapshot changed");
+}
+
+// A reader on another thread reads a chunk, lets a change elsewhere drop
+// the published chunks, then releases its snapshot; the next change to the
+// chunk goes in place. The handshake is relaxed on purpose, so nothing but
+// the chunk's own reference count orders the two (a thread-sanitizer build
+// reports the race if that does not)
+void selfTestSnapshotRelease() {
+    StudentManagementSystem sms;
+    for (int i = 1; i <= 8200; i++) sms.addRecord("r" + to_string(i), i, 50);
+    atomic<int> stage{0};
+    size_t seen = 0;
+    thread reader([&] {
+        {
+            RosterSnapshot snapshot = sms.snapshot();
+            snapshot.forEach([&](string_view name, int, float marks) {
+                seen += !name.empty() && marks == 50;
+                return true;
+            });
+            stage.store(1, memory_order_relaxed);
+            while (stage.load(memory_order_relaxed) != 2) this_thread::yield();
+        }
+        stage.store(3, memory_order_relaxed);
+    });
+    while (stage.load(memory_order_relaxed) != 1) this_thread::yield();
+    sms.updateRecordByRoll(5000, "second", 60);
+    stage.store(2, memory_order_relaxed);
+    while (stage.load(memory_order_relaxed) != 3) this_thread::yield();
+    sms.updateRecordByRoll(1, "first", 70);
+    reader.join();
+    expect(seen == 8200, "the reader's snapshot was incomplete");
+    RosterContents now = contentsOf(sms.snapshot());
+    expect(now[1] == make_pair(string("first"), 70.0f) && now[5000] == make_pair(string("second"), 60.0f),
+           "a change after the snapshot was released was lost");
+}
+
+int runSelfTest() {
+    const pair<const char*, void (*)()> tests[] = {
+        {"concurrent readers and writers", selfTestConcurrency},
+        {"journal replay", selfTestJournalReplay},
+        {"torn transaction", selfTestTornTransaction},
+        {"percentiles and bands", selfTestHistogram},
+        {"snapshot isolation", selfTestSnapshots},
+        {"snapshot released by a reader", selfTestSnapshotRelease},
+    };
+    int failed = 0;
+    for (const auto& [name, test] : tests) {
+        string error;
+        {
+            ScratchDirectory scratch("sms-test-");
+            QuietConsole quiet;
+            try {
+                test();
+            }
+            catch (const exception& e) {
+                error = e.what();
+            }
+        }
+        if (error.empty()) {
+            cout << "ok      " << name << endl;
+        }
+        else {
+            cout << "FAILED  " << name << ": " << error << endl;
+            failed++;
+        }
+    }
+    cout << (failed ? to_string(failed) + " of " + to_string(size(tests)) + " checks failed" : "All checks passed") << endl;
+    return failed ? 1 : 0;
+}
+
+// ========== Main Function ==========
+int main(int argc, char* argv[]) {
+    // Test mode: StudentManagementSystem --self-test
+    if (argc >= 2 && string(argv[1]) == "--self-test") return runSelfTest();
+
+    // Benchmark mode: StudentManagementSystem --bench-stats [rows]
+    if (argc >= 2 && string(argv[1]) == "--bench-stats") {
+        size_t rows = argc >= 3 ? strtoull(argv[2], nullptr, 10) : 10000000;
+        if (rows == 0) {
+            cout << "Usage: " << argv[0] << " --bench-stats [rows]" << endl;
+            return 1;
+        }
+        runStatisticsBenchmark(rows);
+        return 0;
+    }
+
+    // Benchmark mode: StudentManagementSystem --bench-names [rows]
+    if (argc >= 2 && string(argv[1]) == "--bench-names") {
+        size_t rows = argc >= 3 ? strtoull(argv[2], nullptr, 10) : 1000000;
+        if (rows == 0) {
+            cout << "Usage: " << argv[0] << " --bench-names [rows]" << endl;
+            return 1;
+        }
+        runNameStorageBenchmark(rows);
+        return 0;
+    }
+
+    // Benchmark mode: StudentManagementSystem --bench-codec [rows]
+    if (argc >= 2 && string(argv[1]) == "--bench-codec") {
+        size_t rows = argc >= 3 ? strtoull(argv[2], nullptr, 10) : 1000000;
+        if (rows == 0) {
+            cout << "Usage: " << argv[0] << " --bench-codec [rows]" << endl;
+            return 1;
+        }
+        try {
+            runCodecBenchmark(rows);
+        }
+        catch (const exception& e) {
+            cerr << "Benchmark failed: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // Benchmark mode: StudentManagementSystem --bench-suite [maxRows] > bench.json
+    if (argc >= 2 && string(argv[1]) == "--bench-suite") {
+        size_t maxRows = argc >= 3 ? strtoull(argv[2], nullptr, 10) : 1000000;
+        if (maxRows < 1000) {
+            cout << "Usage: " << argv[0] << " --bench-suite [maxRows >= 1000]" << endl;
+            return 1;
+        }
+        runBenchmarkSuite(maxRows);
+        return 0;
+    }
+
+    // Benchmark mode: StudentManagementSystem --bench-concurrency [rows] [threads]
+    if (argc >= 2 && string(argv[1]) == "--bench-concurrency") {
+        size_t rows = argc >= 3 ? strtoull(argv[2], nullptr, 10) : 100000;
+        unsigned threads = argc >= 4 ? static_cast<unsigned>(strtoul(argv[3], nullptr, 10)) : 4;
+        if (rows == 0 || threads == 0) {
+            cout << "Usage: " << argv[0] << " --bench-concurrency [rows] [threads]" << endl;
+            return 1;
+        }
+        runConcurrencyBenchmark(rows, threads);
+        return 0;
+    }
+
+    // Storage mode: StudentManagementSystem --storage binary|compressed
+    if (argc >= 2 && string(argv[1]) == "--storage") {
+        string format = argc >= 3 ? argv[2] : "";
+        if (format != "binary" && format != "compressed") {
+            cout << "Usage: " << argv[0] << " --storage binary|compressed" << endl;
+            return 1;
+        }
+        StudentManagementSystem sms;
+        try {
+            sms.setPackedFormat(format == "compressed");
+        }
+        catch (const StudentException& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // Backup inspection: StudentManagementSystem --lookup <file> <rollNo>
+    // Reads one record from a compressed data file, decoding only its block
+    if (argc >= 2 && string(argv[1]) == "--lookup") {
+        if (argc < 4) {
+            cout << "Usage: " << argv[0] << " --lookup <compressed file> <rollNo>" << endl;
+            return 1;
+        }
+        try {
+            PackedRoster packed;
+            packed.open(argv[2]);
+            optional<Student> s = packed.find(parseNumber<int>(argv[3], "roll number"));
+            if (!s) {
+                cout << "Student not found" << endl;
+                return 1;
+            }
+            s->display();
+        }
+        catch (const StudentException& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // Storage mode: StudentManagementSystem --shards <n>
+    // Rewrites the roster across n files (1 = a single students.dat)
+    if (argc >= 2 && string(argv[1]) == "--shards") {
+        size_t shards = argc >= 3 ? strtoull(argv[2], nullptr, 10) : 0;
+        if (shards == 0 || shards > MAX_SHARDS) {
+            cout << "Usage: " << argv[0] << " --shards <1-" << MAX_SHARDS << ">" << endl;
+            return 1;
+        }
+        StudentManagementSystem sms;
+        try {
+            sms.setShardCount(shards);   // written by the flusher or, at the latest, on exit
+        }
+        catch (const StudentException& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // Server mode: StudentManagementSystem --serve [port] [address]
+    // Follower:    StudentManagementSystem --follow <primary address>:<port> [port] [address]
+    //              serves a read-only copy of the primary's roster (default port 7071)
+    bool follow = argc >= 2 && string(argv[1]) == "--follow";
+    if (argc >= 2 && (string(argv[1]) == "--serve" || follow)) {
+#ifdef SMS_HAVE_EPOLL
+        int first = follow ? 3 : 2;   // first of [port] [address]
+        unsigned long port = argc > first ? strtoul(argv[first], nullptr, 10) : (follow ? 7071 : 7070);
+        string address = argc > first + 1 ? argv[first + 1] : "127.0.0.1";
+        if (port > 65535 || (follow && argc < 3)) {
+            cout << "Usage: " << argv[0] << " --serve [port] [address]" << endl;
+            cout << "       " << argv[0] << " --follow <primary address>:<port> [port] [address]" << endl;
+            return 1;
+        }
+        try {
+            StudentManagementSystem sms;
+            sms.setDeferredSync(true);   // the server syncs once per round
+            sms.enableReplication();
+            unique_ptr<Replica> replica;
+            if (follow) replica = make_unique<Replica>(sms, argv[2]);
+            Server server(sms, replica.get());
+            uint16_t bound = server.start(address, static_cast<uint16_t>(port));
+
+            struct sigaction action{};
+            action.sa_handler = stopServer;   // no SA_RESTART: epoll_wait must return
+            sigaction(SIGINT, &action, nullptr);
+            sigaction(SIGTERM, &action, nullptr);
+
+            if (replica) replica->start();
+            cout << "Listening on " << address << ":" << bound;
+            if (replica) cout << " as a replica of " << replica->primaryAddress();
+            cout << " (Ctrl+C to stop)" << endl;
+            server.run();
+            if (replica) replica->stop();
+            cout << "Shutting down..." << endl;
+        }
+        catch (const exception& e) {
+            cerr << "Server error: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+#else
+        cerr << "Server mode is only available on Linux (epoll)" << endl;
+        return 1;
+#endif
+    }
+
+    // Import mode: StudentManagementSystem --import roster.csv [rejects.csv]
+    if (argc >= 2 && string(argv[1]) == "--import") {
+        if (argc < 3) {
+            cout << "Usage: " << argv[0] << " --import <file.csv> [rejects.csv]" << endl;
+            return 1;
+        }
+        string rejectsPath = argc >= 4 ? argv[3] : string(argv[2]) + ".rejects.csv";
+        try {
+            StudentManagementSystem sms;
+            ImportSummary result = sms.importCsv(argv[2], rejectsPath);
+            cout << "Imported " << result.imported << " records";
+            if (result.rejected > 0) cout << "; " << result.rejected << " rows rejected (see " << rejectsPath << ")";
+            cout << "." << endl;
+        }
+        catch (const exception& e) {
+            cerr << "Import failed: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // Export mode: StudentManagementSystem --export csv|tsv [file]   (stdout if no file)
+    if (argc >= 2 && string(argv[1]) == "--export") {
+        try {
+            TableFormat format = parseTableFormat(argc >= 3 ? argv[2] : "csv");
+            // Load/save chatter goes to stderr so stdout carries only the data
+            streambuf* console = cout.rdbuf(cerr.rdbuf());
+            StudentManagementSystem sms;
+            cout.rdbuf(console);
+            if (argc >= 4) {
+                ofstream file(argv[3], ios::binary | ios::trunc);
+                if (!file) throw StudentException(string("Cannot create ") + argv[3]);
+                sms.displayAll(format, 0, file);
+                file.close();
+                if (file.fail()) throw StudentException(string("Failed to write ") + argv[3]);
+            }
+            else {
+                sms.displayAll(format);
+            }
+            cout.rdbuf(cerr.rdbuf());
+        }
+        catch (const exception& e) {
+            cerr << "Export failed: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // Batch mode: StudentManagementSystem --batch [file]   (stdin if no file)
+    if (argc >= 2 && string(argv[1]) == "--batch") {
+        ios::sync_with_stdio(false);
+        StudentManagementSystem sms;
+        if (argc >= 3 && string(argv[2]) != "-") {
+            ifstream commands(argv[2]);
+            if (!commands) {
+                cerr << "Cannot open batch file " << argv[2] << endl;
+                return 1;
+            }
+            runBatch(sms, commands);
+        }
+        else {
+            runBatch(sms, cin);
+        }
+        return 0;
+    }
+
+    StudentManagementSystem sms;
+    int choice = 0;
 
     cout << "=== STUDENT MANAGEMENT SYSTEM ===" << endl;
 
@@ -366,10 +7089,18 @@ int main() {
         cout << "5. Delete Student" << endl;
         cout << "6. Show Statistics" << endl;
         cout << "7. Exit" << endl;
-        cout << "Enter your choice (1-7): ";
+        cout << "8. Marks Range / Top-K Queries" << endl;
+        cout << "9. Search Student by Name" << endl;
+        cout << "10. Performance Stats" << endl;
+        cout << "Enter your choice (1-10): ";
 
         try {
             if (!(cin >> choice)) {
+                if (cin.eof()) {
+                    // Input closed: leave as if Exit had been chosen
+                    choice = 7;
+                    break;
+                }
                 cin.clear();
                 cin.ignore(numeric_limits<streamsize>::max(), '\n');
                 throw StudentException("Invalid menu choice");
@@ -377,18 +7108,40 @@ int main() {
 
             switch (choice) {
                 case 1: sms.addStudent(); break;
-                case 2: sms.displayAll(); break;
+                case 2: {
+                    int order;
+                    cout << "Order (1 = as added, 2 = name, 3 = roll no, 4 = marks): ";
+                    if (!(cin >> order) || order < 1 || order > 4) {
+                        cin.clear();
+                        clearLine();
+                        throw StudentException("Invalid order");
+                    }
+                    // Page through long listings when a person is at the terminal
+                    clearLine();
+                    sms.displayAll(TableFormat::Table, interactiveTerminal() ? 20 : 0, cout, static_cast<SortKey>(order - 1));
+                    break;
+                }
                 case 3: sms.searchStudent(); break;
                 case 4: sms.updateStudent(); break;
                 case 5: sms.deleteStudent(); break;
-                case 6: sms.showStatistics(); break;
+                case 6: sms.statisticsMenu(); break;
                 case 7: cout << "Exiting... Thank you for using the system!" << endl; break;
-                default: cout << "Invalid choice! Please enter 1-7." << endl;
+                case 8: sms.marksQueries(); break;
+                case 9: sms.searchByName(); break;
+                case 10: reportPerformance(cout); break;
+                default: cout << "Invalid choice! Please enter 1-10." << endl;
             }
         }
         catch (const exception& e) {
             cout << "System Error: " << e.what() << endl;
         }
+
+        try {
+            sms.sync();
+        }
+        catch (const exception& e) {
+            cout << "System Error: " << e.what() << endl;
+        }
     } while (choice != 7);
 
     return 0;